@@ -6,6 +6,7 @@
 #include "threads/malloc.h"
 #include "filesys/sector_cache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
 
 /* A block device. */
 struct block {
@@ -92,27 +93,51 @@ static void check_sector(struct block* block, block_sector_t sector) {
   }
 }
 
-// ensures atleast one free slot in cache
-void block_cache_add(struct block* block, block_sector_t sector, void* buffer, uint8_t dirty) {
+// ensures atleast one free slot in cache; returns false without adding
+// the sector if every slot holds a journaled sector
+bool block_cache_add(struct block* block, block_sector_t sector, void* buffer, uint8_t dirty,
+                     uint8_t journaled) {
   uint8_t evicted_buffer[BLOCK_SECTOR_SIZE];
   block_sector_t evicted_sector;
   uint8_t evicted_dirty;
 
-  uint8_t ret = cache_add(&filesys_cache, buffer, sector, dirty, &evicted_sector, &evicted_dirty,
-                          evicted_buffer);
+  uint8_t ret = cache_add(&filesys_cache, buffer, sector, dirty, journaled, &evicted_sector,
+                          &evicted_dirty, evicted_buffer);
+  if (ret == CACHE_FULL)
+    return false;
   if (ret && evicted_dirty) {
     block->ops->write(block->aux, evicted_sector, evicted_buffer);
     block->write_cnt++;
   }
+  return true;
 }
 
 void block_cache_flush(struct block* block) {
   uint8_t buffer[512];
   block_sector_t sector;
+  lock_acquire(&filesys_cache.miss_lock);
   while (cache_get_dirty(&filesys_cache, buffer, &sector)) {
     block->ops->write(block->aux, sector, buffer);
     block->write_cnt++;
   }
+  lock_release(&filesys_cache.miss_lock);
+}
+
+/* Writes every dirty sector of BLOCK's cache that is not waiting
+   for a journal commit to its home location, leaving it cached. */
+void block_flush_data(struct block* block) {
+  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  block_sector_t sector;
+
+  ASSERT(block == fs_device);
+  // under miss_lock, so that eviction cannot write a newer copy of
+  // the same sector in between
+  lock_acquire(&filesys_cache.miss_lock);
+  while (cache_get_dirty_data(&filesys_cache, buffer, &sector)) {
+    block->ops->write(block->aux, sector, buffer);
+    block->write_cnt++;
+  }
+  lock_release(&filesys_cache.miss_lock);
 }
 
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
@@ -125,10 +150,17 @@ void block_read(struct block* block, block_sector_t sector, void* buffer) {
   if (block == fs_device) {
     if (cache_read(&filesys_cache, sector, buffer, 0, BLOCK_SECTOR_SIZE))
       return;
-    block->ops->read(block->aux, sector, buffer);
-    block->read_cnt++;
 
-    block_cache_add(block, sector, buffer, 0);
+    // another thread may have brought the sector in while we waited
+    lock_acquire(&filesys_cache.miss_lock);
+    if (!cache_read(&filesys_cache, sector, buffer, 0, BLOCK_SECTOR_SIZE)) {
+      block->ops->read(block->aux, sector, buffer);
+      block->read_cnt++;
+
+      // a cache full of journaled sectors just leaves this one uncached
+      block_cache_add(block, sector, buffer, 0, 0);
+    }
+    lock_release(&filesys_cache.miss_lock);
   } else {
     block->ops->read(block->aux, sector, buffer);
     block->read_cnt++;
@@ -152,6 +184,37 @@ void block_read_offsz(struct block* block, block_sector_t sector, void* buffer,
   }
 }
 
+/* Writes SZ bytes from BUFFER at OFFSET within sector SECTOR of
+   the file system device through the cache, marking the sector as
+   journaled metadata if JOURNALED is nonzero. */
+static void cached_write(struct block* block, block_sector_t sector, const void* buffer, int offset,
+                         int sz, uint8_t journaled) {
+  if (cache_write(&filesys_cache, sector, buffer, offset, sz, journaled))
+    return;
+
+  // read-modify-write under miss_lock so that concurrent writers of
+  // disjoint parts of the same sector do not lose each other's bytes
+  for (;;) {
+    uint8_t tempbuffer[BLOCK_SECTOR_SIZE];
+
+    lock_acquire(&filesys_cache.miss_lock);
+    if (cache_write(&filesys_cache, sector, buffer, offset, sz, journaled))
+      break;
+    if (offset != 0 || sz != BLOCK_SECTOR_SIZE) {
+      block->ops->read(block->aux, sector, tempbuffer);
+      block->read_cnt++;
+    }
+    memcpy(tempbuffer + offset, buffer, sz);
+    if (block_cache_add(block, sector, tempbuffer, 1, journaled))
+      break;
+
+    // every slot waits for the journal, and a commit takes miss_lock
+    lock_release(&filesys_cache.miss_lock);
+    journal_commit_full();
+  }
+  lock_release(&filesys_cache.miss_lock);
+}
+
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
    BLOCK_SECTOR_SIZE bytes.  Returns after the block device has
    acknowledged receiving the data.
@@ -160,10 +223,9 @@ void block_read_offsz(struct block* block, block_sector_t sector, void* buffer,
 void block_write(struct block* block, block_sector_t sector, const void* buffer) {
   check_sector(block, sector);
   ASSERT(block->type != BLOCK_FOREIGN);
-  if (block == fs_device) {
-    if (!cache_write(&filesys_cache, sector, buffer, 0, BLOCK_SECTOR_SIZE))
-      block_cache_add(block, sector, buffer, 1);
-  } else {
+  if (block == fs_device)
+    cached_write(block, sector, buffer, 0, BLOCK_SECTOR_SIZE, 0);
+  else {
     block->ops->write(block->aux, sector, buffer);
     block->write_cnt++;
   }
@@ -173,21 +235,125 @@ void block_write_offsz(struct block* block, block_sector_t sector, const void* b
                        int sz) {
   check_sector(block, sector);
   ASSERT(block->type != BLOCK_FOREIGN);
-  if (block == fs_device) {
-    if (!cache_write(&filesys_cache, sector, buffer, offset, sz)) {
-      uint8_t tempbuffer[BLOCK_SECTOR_SIZE];
+  if (block == fs_device)
+    cached_write(block, sector, buffer, offset, sz, 0);
+  else {
+    ASSERT(0);
+  }
+}
 
-      if (offset != 0) // || sz
-        block_read(block, sector, tempbuffer);
+/* Like block_write_offsz(), but SECTOR holds file system metadata:
+   it stays in the cache until the journal has committed it, and
+   only then is written to its home location. */
+void block_write_meta(struct block* block, block_sector_t sector, const void* buffer, int offset,
+                      int sz) {
+  check_sector(block, sector);
+  ASSERT(block == fs_device);
+  journal_make_room();
+  cached_write(block, sector, buffer, offset, sz, journal_enabled());
+}
 
-      memcpy(tempbuffer + offset, buffer, sz);
-      block_write(block, sector, tempbuffer);
-    }
-  } else {
-    ASSERT(0);
+/* Reads sector SECTOR of BLOCK into BUFFER straight from the
+   device, bypassing the cache.  The caller must make sure the
+   cache holds no newer copy. */
+void block_read_raw(struct block* block, block_sector_t sector, void* buffer) {
+  check_sector(block, sector);
+  block->ops->read(block->aux, sector, buffer);
+  block->read_cnt++;
+}
+
+/* Writes BUFFER to sector SECTOR of BLOCK straight to the device,
+   bypassing the cache.  The caller must make sure the cache does
+   not hold SECTOR, or holds the same data. */
+void block_write_raw(struct block* block, block_sector_t sector, const void* buffer) {
+  check_sector(block, sector);
+  ASSERT(block->type != BLOCK_FOREIGN);
+  block->ops->write(block->aux, sector, buffer);
+  block->write_cnt++;
+}
+
+/* Reads the CNT consecutive sectors of BLOCK starting at SECTOR
+   into BUFFER straight from the device, bypassing the cache, in a
+   single transfer if the driver supports it. */
+void block_read_multi(struct block* block, block_sector_t sector, block_sector_t cnt,
+                      void* buffer) {
+  block_sector_t i;
+
+  check_sector(block, sector + cnt - 1);
+  if (block->ops->read_multi != NULL)
+    block->ops->read_multi(block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->read(block->aux, sector + i, (uint8_t*)buffer + i * BLOCK_SECTOR_SIZE);
+  block->read_cnt += cnt;
+}
+
+/* Writes BUFFER to the CNT consecutive sectors of BLOCK starting
+   at SECTOR straight to the device, bypassing the cache, in a
+   single transfer if the driver supports it. */
+void block_write_multi(struct block* block, block_sector_t sector, block_sector_t cnt,
+                       const void* buffer) {
+  block_sector_t i;
+
+  check_sector(block, sector + cnt - 1);
+  ASSERT(block->type != BLOCK_FOREIGN);
+  if (block->ops->write_multi != NULL)
+    block->ops->write_multi(block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->write(block->aux, sector + i, (const uint8_t*)buffer + i * BLOCK_SECTOR_SIZE);
+  block->write_cnt += cnt;
+}
+
+/* Reads CNT consecutive sectors of the file system device starting
+   at SECTOR into BUFFER without bringing them into the cache.
+   Sectors that are cached are copied from the cache, since it may
+   hold newer data than the disk; the rest are read from the device
+   in as few transfers as possible.  The caller must keep the
+   sectors from being written meanwhile, as an inode's range lock
+   does. */
+void block_read_direct(struct block* block, block_sector_t sector, block_sector_t cnt,
+                       void* buffer) {
+  uint8_t* p = buffer;
+  block_sector_t i = 0, j;
+
+  ASSERT(block == fs_device);
+  while (i < cnt) {
+    // the cache is checked under miss_lock, so that no eviction is
+    // still writing one of the missing sectors back, but the device
+    // is read without it, so that a long transfer does not hold up
+    // every other cache miss
+    lock_acquire(&filesys_cache.miss_lock);
+    while (i < cnt &&
+           cache_read(&filesys_cache, sector + i, p + i * BLOCK_SECTOR_SIZE, 0, BLOCK_SECTOR_SIZE))
+      i++;
+    for (j = i; j < cnt && !cache_contains(&filesys_cache, sector + j); j++)
+      continue;
+    lock_release(&filesys_cache.miss_lock);
+
+    if (j > i)
+      block_read_multi(block, sector + i, j - i, p + i * BLOCK_SECTOR_SIZE);
+    i = j;
   }
 }
 
+/* Writes BUFFER to CNT consecutive sectors of the file system
+   device starting at SECTOR in a single transfer, without going
+   through the cache.  Cached copies of those sectors are dropped
+   first, so that they can neither be read nor written back over
+   the new data later. */
+void block_write_direct(struct block* block, block_sector_t sector, block_sector_t cnt,
+                        const void* buffer) {
+  block_sector_t i;
+
+  ASSERT(block == fs_device);
+  lock_acquire(&filesys_cache.miss_lock);
+  for (i = 0; i < cnt; i++)
+    cache_discard(&filesys_cache, sector + i);
+  block_write_multi(block, sector, cnt, buffer);
+  lock_release(&filesys_cache.miss_lock);
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t block_size(struct block* block) { return block->size; }
 
@@ -55,6 +55,14 @@ void block_read_offsz(struct block* block, block_sector_t sector, void* buffer,
 void block_write(struct block*, block_sector_t, const void*);
 void block_write_offsz(struct block* block, block_sector_t sector, const void* buffer, int offset,
                        int sz);
+void block_write_meta(struct block* block, block_sector_t sector, const void* buffer, int offset,
+                      int sz);
+void block_read_raw(struct block*, block_sector_t, void*);
+void block_write_raw(struct block*, block_sector_t, const void*);
+void block_read_multi(struct block*, block_sector_t, block_sector_t cnt, void*);
+void block_write_multi(struct block*, block_sector_t, block_sector_t cnt, const void*);
+void block_read_direct(struct block*, block_sector_t, block_sector_t cnt, void*);
+void block_write_direct(struct block*, block_sector_t, block_sector_t cnt, const void*);
 const char* block_name(struct block*);
 enum block_type block_type(struct block*);
 
@@ -66,10 +74,15 @@ void block_print_stats(void);
 struct block_operations {
   void (*read)(void* aux, block_sector_t, void* buffer);
   void (*write)(void* aux, block_sector_t, const void* buffer);
+
+  /* Optional: transfer CNT consecutive sectors at once. */
+  void (*read_multi)(void* aux, block_sector_t, block_sector_t cnt, void* buffer);
+  void (*write_multi)(void* aux, block_sector_t, block_sector_t cnt, const void* buffer);
 };
 
 struct block* block_register(const char* name, enum block_type, const char* extra_info,
                              block_sector_t size, const struct block_operations*, void* aux);
 
 void block_cache_flush(struct block* block);
+void block_flush_data(struct block* block);
 #endif /* devices/block.h */
@@ -83,7 +83,7 @@ static void reset_channel(struct channel*);
 static bool check_device_type(struct ata_disk*);
 static void identify_ata_device(struct ata_disk*);
 
-static void select_sector(struct ata_disk*, block_sector_t);
+static void select_sector(struct ata_disk*, block_sector_t, block_sector_t cnt);
 static void issue_pio_command(struct channel*, uint8_t command);
 static void input_sector(struct channel*, void*);
 static void output_sector(struct channel*, const void*);
@@ -314,7 +314,7 @@ static void ide_read(void* d_, block_sector_t sec_no, void* buffer) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
+  select_sector(d, sec_no, 1);
   issue_pio_command(c, CMD_READ_SECTOR_RETRY);
   sema_down(&c->completion_wait);
   if (!wait_while_busy(d))
@@ -332,7 +332,7 @@ static void ide_write(void* d_, block_sector_t sec_no, const void* buffer) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
+  select_sector(d, sec_no, 1);
   issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
   if (!wait_while_busy(d))
     PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
@@ -341,18 +341,81 @@ static void ide_write(void* d_, block_sector_t sec_no, const void* buffer) {
   lock_release(&c->lock);
 }
 
-static struct block_operations ide_operations = {ide_read, ide_write};
+/* Most sectors one READ SECTOR or WRITE SECTOR command moves. */
+#define IDE_MULTI_MAX 256
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, using one command per IDE_MULTI_MAX sectors.  The disk
+   interrupts once per sector as each becomes ready. */
+static void ide_read_multi(void* d_, block_sector_t sec_no, block_sector_t cnt, void* buffer) {
+  struct ata_disk* d = d_;
+  struct channel* c = d->channel;
+  uint8_t* p = buffer;
+
+  while (cnt > 0) {
+    block_sector_t n = cnt < IDE_MULTI_MAX ? cnt : IDE_MULTI_MAX;
+    block_sector_t i;
+
+    lock_acquire(&c->lock);
+    select_sector(d, sec_no, n);
+    issue_pio_command(c, CMD_READ_SECTOR_RETRY);
+    for (i = 0; i < n; i++) {
+      sema_down(&c->completion_wait);
+      if (!wait_while_busy(d))
+        PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no + i);
+      input_sector(c, p);
+      p += BLOCK_SECTOR_SIZE;
+    }
+    lock_release(&c->lock);
+    sec_no += n;
+    cnt -= n;
+  }
+}
+
+/* Writes BUFFER to the CNT sectors starting at SEC_NO on disk D,
+   using one command per IDE_MULTI_MAX sectors.  The disk asks for
+   each sector in turn and interrupts once each is written. */
+static void ide_write_multi(void* d_, block_sector_t sec_no, block_sector_t cnt,
+                            const void* buffer) {
+  struct ata_disk* d = d_;
+  struct channel* c = d->channel;
+  const uint8_t* p = buffer;
+
+  while (cnt > 0) {
+    block_sector_t n = cnt < IDE_MULTI_MAX ? cnt : IDE_MULTI_MAX;
+    block_sector_t i;
+
+    lock_acquire(&c->lock);
+    select_sector(d, sec_no, n);
+    issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
+    for (i = 0; i < n; i++) {
+      if (!wait_while_busy(d))
+        PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no + i);
+      output_sector(c, p);
+      p += BLOCK_SECTOR_SIZE;
+      sema_down(&c->completion_wait);
+    }
+    lock_release(&c->lock);
+    sec_no += n;
+    cnt -= n;
+  }
+}
+
+static struct block_operations ide_operations = {ide_read, ide_write, ide_read_multi,
+                                                 ide_write_multi};
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
+   writes SEC_NO and the number of sectors CNT, at most
+   IDE_MULTI_MAX, to the disk's sector selection registers.  (We
    use LBA mode.) */
-static void select_sector(struct ata_disk* d, block_sector_t sec_no) {
+static void select_sector(struct ata_disk* d, block_sector_t sec_no, block_sector_t cnt) {
   struct channel* c = d->channel;
 
   ASSERT(sec_no < (1UL << 28));
+  ASSERT(cnt > 0 && cnt <= IDE_MULTI_MAX);
 
   select_device_wait(d);
-  outb(reg_nsect(c), 1);
+  outb(reg_nsect(c), cnt == IDE_MULTI_MAX ? 0 : cnt);
   outb(reg_lbal(c), sec_no);
   outb(reg_lbam(c), sec_no >> 8);
   outb(reg_lbah(c), (sec_no >> 16));
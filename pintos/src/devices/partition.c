@@ -286,4 +286,22 @@ static void partition_write(void* p_, block_sector_t sector, const void* buffer)
   block_write(p->block, p->start + sector, buffer);
 }
 
-static struct block_operations partition_operations = {partition_read, partition_write};
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFER. */
+static void partition_read_multi(void* p_, block_sector_t sector, block_sector_t cnt,
+                                 void* buffer) {
+  struct partition* p = p_;
+  block_read_multi(p->block, p->start + sector, cnt, buffer);
+}
+
+/* Writes BUFFER to CNT sectors starting at SECTOR on partition
+   P. */
+static void partition_write_multi(void* p_, block_sector_t sector, block_sector_t cnt,
+                                  const void* buffer) {
+  struct partition* p = p_;
+  block_write_multi(p->block, p->start + sector, cnt, buffer);
+}
+
+static struct block_operations partition_operations = {partition_read, partition_write,
+                                                       partition_read_multi,
+                                                       partition_write_multi};
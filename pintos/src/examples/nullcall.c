@@ -0,0 +1,64 @@
+/* nullcall.c
+
+   Measures the latency of a system call that does no work,
+   practice(), entered the way the C library enters the kernel
+   (SYSENTER where the CPU has it) and through int $0x30, in CPU
+   cycles per call.
+
+   Usage: nullcall [iterations] */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "../syscall-nr.h"
+
+/* Returns the CPU's time-stamp counter. */
+static uint64_t rdtsc(void) {
+  uint64_t tsc;
+  asm volatile("rdtsc" : "=A"(tsc));
+  return tsc;
+}
+
+/* Invokes practice(I) through int $0x30, bypassing the C
+   library's choice of entry path. */
+static int practice_int(int i) {
+  int retval;
+  asm volatile("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp"
+               : "=a"(retval)
+               : [number] "i"(SYS_PRACTICE), [arg0] "g"(i)
+               : "memory");
+  return retval;
+}
+
+int main(int argc, char* argv[]) {
+  int iters = argc > 1 ? atoi(argv[1]) : 100000;
+  uint64_t start, lib, intr;
+  int i;
+
+  if (iters <= 0) {
+    printf("usage: nullcall [iterations]\n");
+    return 1;
+  }
+
+  /* Warm up, and pick the C library's entry path. */
+  if (practice(1) != 2 || practice_int(1) != 2) {
+    printf("nullcall: practice() returned a wrong value\n");
+    return 1;
+  }
+
+  start = rdtsc();
+  for (i = 0; i < iters; i++)
+    practice(i);
+  lib = rdtsc() - start;
+
+  start = rdtsc();
+  for (i = 0; i < iters; i++)
+    practice_int(i);
+  intr = rdtsc() - start;
+
+  printf("%d null system calls\n", iters);
+  printf("  C library entry: %llu cycles/call\n", lib / iters);
+  printf("  int $0x30:       %llu cycles/call\n", intr / iters);
+  return 0;
+}
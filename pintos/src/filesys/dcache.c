@@ -0,0 +1,158 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Maximum number of names cached. */
+#define DCACHE_SIZE 256
+
+/* A cached name: the result, positive or negative, of searching
+   directory PARENT for NAME. */
+struct dentry {
+  struct hash_elem hash_elem; /* Element in dentries. */
+  struct list_elem lru_elem;  /* Element in lru. */
+  block_sector_t parent;      /* Sector of the directory searched. */
+  char name[NAME_MAX + 1];    /* Name searched for. */
+  bool negative;              /* True if NAME is not in PARENT. */
+  struct dcache_entry entry;  /* What was found, if not NEGATIVE. */
+};
+
+static struct hash dentries; /* Cached names, keyed by parent and name. */
+static struct list lru;      /* Cached names, most recently used first. */
+static struct lock dcache_lock;
+
+/* Bumped by every invalidation.  A name looked up on disk is only
+   cached if no invalidation happened meanwhile, so a lookup racing
+   with dir_add() or dir_remove() cannot cache a stale answer. */
+static unsigned dcache_gen;
+
+static unsigned dentry_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct dentry* d = hash_entry(e, struct dentry, hash_elem);
+  return hash_string(d->name) ^ hash_int(d->parent);
+}
+
+static bool dentry_less(const struct hash_elem* a_, const struct hash_elem* b_,
+                        void* aux UNUSED) {
+  const struct dentry* a = hash_entry(a_, struct dentry, hash_elem);
+  const struct dentry* b = hash_entry(b_, struct dentry, hash_elem);
+  return a->parent != b->parent ? a->parent < b->parent : strcmp(a->name, b->name) < 0;
+}
+
+/* Initializes the directory entry cache. */
+void dcache_init(void) {
+  hash_init(&dentries, dentry_hash, dentry_less, NULL);
+  list_init(&lru);
+  lock_init(&dcache_lock);
+  dcache_gen = 0;
+}
+
+/* Returns the cached name NAME in directory DIR, or a null
+   pointer.  dcache_lock must be held. */
+static struct dentry* find(block_sector_t dir, const char* name) {
+  struct dentry key;
+  struct hash_elem* e;
+
+  if (strlen(name) > NAME_MAX)
+    return NULL;
+  key.parent = dir;
+  strlcpy(key.name, name, sizeof key.name);
+  e = hash_find(&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops D from the cache.  dcache_lock must be held. */
+static void drop(struct dentry* d) {
+  hash_delete(&dentries, &d->hash_elem);
+  list_remove(&d->lru_elem);
+  free(d);
+}
+
+/* Looks up NAME in directory DIR.  On DCACHE_HIT, stores what was
+   found into *ENTRY.  Stores into *GEN a value to pass to
+   dcache_insert() after searching the directory on a miss. */
+enum dcache_result dcache_lookup(block_sector_t dir, const char* name, struct dcache_entry* entry,
+                                 unsigned* gen) {
+  enum dcache_result result = DCACHE_MISS;
+  struct dentry* d;
+
+  lock_acquire(&dcache_lock);
+  *gen = dcache_gen;
+  d = find(dir, name);
+  if (d != NULL) {
+    list_remove(&d->lru_elem);
+    list_push_front(&lru, &d->lru_elem);
+    if (d->negative)
+      result = DCACHE_NEGATIVE;
+    else {
+      *entry = d->entry;
+      result = DCACHE_HIT;
+    }
+  }
+  lock_release(&dcache_lock);
+  return result;
+}
+
+/* Caches the result of searching directory DIR for NAME: ENTRY if
+   it was found, or a negative entry if ENTRY is null.  Does
+   nothing if the cache was invalidated since GEN was obtained from
+   dcache_lookup(). */
+void dcache_insert(block_sector_t dir, const char* name, const struct dcache_entry* entry,
+                   unsigned gen) {
+  struct dentry* d;
+
+  if (strlen(name) > NAME_MAX)
+    return;
+
+  lock_acquire(&dcache_lock);
+  if (gen != dcache_gen || find(dir, name) != NULL) {
+    lock_release(&dcache_lock);
+    return;
+  }
+
+  if (hash_size(&dentries) >= DCACHE_SIZE)
+    drop(list_entry(list_back(&lru), struct dentry, lru_elem));
+  d = malloc(sizeof *d);
+  if (d != NULL) {
+    d->parent = dir;
+    strlcpy(d->name, name, sizeof d->name);
+    d->negative = entry == NULL;
+    if (entry != NULL)
+      d->entry = *entry;
+    hash_insert(&dentries, &d->hash_elem);
+    list_push_front(&lru, &d->lru_elem);
+  }
+  lock_release(&dcache_lock);
+}
+
+/* Forgets whatever is cached about NAME in directory DIR.  Called
+   whenever an entry is added to or removed from a directory. */
+void dcache_invalidate(block_sector_t dir, const char* name) {
+  struct dentry* d;
+
+  lock_acquire(&dcache_lock);
+  dcache_gen++;
+  d = find(dir, name);
+  if (d != NULL)
+    drop(d);
+  lock_release(&dcache_lock);
+}
+
+/* Forgets every name cached for directory DIR, which is being
+   removed or, if its sector is being reused, created. */
+void dcache_purge_dir(block_sector_t dir) {
+  struct list_elem* e;
+
+  lock_acquire(&dcache_lock);
+  dcache_gen++;
+  for (e = list_begin(&lru); e != list_end(&lru);) {
+    struct dentry* d = list_entry(e, struct dentry, lru_elem);
+    e = list_next(e);
+    if (d->parent == dir)
+      drop(d);
+  }
+  lock_release(&dcache_lock);
+}
@@ -0,0 +1,29 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* Result of looking up a name in the directory entry cache. */
+enum dcache_result {
+  DCACHE_MISS,     /* Not cached; the directory must be searched. */
+  DCACHE_NEGATIVE, /* Cached as not present in the directory. */
+  DCACHE_HIT       /* Cached as present. */
+};
+
+/* What the cache remembers about a name found in a directory. */
+struct dcache_entry {
+  block_sector_t inode_sector; /* Sector of the named inode. */
+  bool is_dir;                 /* Is it a directory? */
+  off_t ofs;                   /* Offset of the entry in the directory. */
+};
+
+void dcache_init(void);
+enum dcache_result dcache_lookup(block_sector_t dir, const char* name, struct dcache_entry*,
+                                 unsigned* gen);
+void dcache_insert(block_sector_t dir, const char* name, const struct dcache_entry*, unsigned gen);
+void dcache_invalidate(block_sector_t dir, const char* name);
+void dcache_purge_dir(block_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -1,9 +1,13 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <dirent.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "devices/block.h"
 #include "threads/malloc.h"
@@ -24,9 +28,428 @@ struct dir_entry {
   bool is_dir;                 /* Is entry a directory or not? */
 };
 
+/* Directories with at least this many entry slots get a hashed
+   index. */
+#define INDEX_THRESHOLD 32
+
+/* A directory with at least this many entry slots is compacted
+   once more than half of them are free. */
+#define COMPACT_THRESHOLD 32
+
+/* A directory's hashed index lives in its own inode, recorded in
+   the directory's inode.  It starts with this header, followed by
+   an open-addressing hash table of SLOT_CNT struct index_slots
+   keyed by name hash.  The directory's entries stay in the
+   ordinary linear format, so dropping the index is always safe. */
+struct index_header {
+  uint32_t slot_cnt; /* Number of slots, a power of 2. */
+  uint32_t fill_cnt; /* Slots in use or deleted. */
+};
+
+/* A slot in a directory index. */
+struct index_slot {
+  uint32_t hash;  /* hash_string() of the entry's name. */
+  uint32_t entry; /* Entry number + 1, or SLOT_EMPTY or SLOT_DELETED. */
+};
+
+#define SLOT_EMPTY 0            /* Slot never used; ends a probe. */
+#define SLOT_DELETED UINT32_MAX /* Slot freed; probes continue past it. */
+
+/* Returns the byte offset of slot I in an index file. */
+static off_t slot_ofs(size_t i) {
+  return sizeof(struct index_header) + i * sizeof(struct index_slot);
+}
+
+/* Searches index IDX of directory DIR for NAME.  If found, stores
+   the entry into *EP and its offset in DIR into *OFSP and returns
+   true. */
+static bool index_find(struct inode* dir, struct inode* idx, const char* name,
+                       struct dir_entry* ep, off_t* ofsp) {
+  uint32_t hash = hash_string(name);
+  struct index_header h;
+  struct index_slot s;
+  size_t i, n;
+
+  if (inode_read_at(idx, &h, sizeof h, 0) != sizeof h)
+    return false;
+  for (i = hash & (h.slot_cnt - 1), n = 0; n < h.slot_cnt; i = (i + 1) & (h.slot_cnt - 1), n++) {
+    if (inode_read_at(idx, &s, sizeof s, slot_ofs(i)) != sizeof s || s.entry == SLOT_EMPTY)
+      break;
+    if (s.entry != SLOT_DELETED && s.hash == hash) {
+      off_t ofs = (s.entry - 1) * sizeof *ep;
+      if (inode_read_at(dir, ep, sizeof *ep, ofs) == sizeof *ep && ep->in_use &&
+          !strcmp(ep->name, name)) {
+        *ofsp = ofs;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/* Adds the entry at offset OFS, whose name hashes to HASH, to
+   index IDX.  Returns false if the table is too full, in which case
+   the index must be rebuilt larger, or on error. */
+static bool index_insert(struct inode* idx, uint32_t hash, off_t ofs) {
+  struct index_header h;
+  struct index_slot s;
+  size_t i;
+
+  if (inode_read_at(idx, &h, sizeof h, 0) != sizeof h || (h.fill_cnt + 1) * 4 > h.slot_cnt * 3)
+    return false;
+  for (i = hash & (h.slot_cnt - 1);; i = (i + 1) & (h.slot_cnt - 1)) {
+    if (inode_read_at(idx, &s, sizeof s, slot_ofs(i)) != sizeof s)
+      return false;
+    if (s.entry == SLOT_EMPTY || s.entry == SLOT_DELETED)
+      break;
+  }
+  if (s.entry == SLOT_EMPTY) {
+    h.fill_cnt++;
+    if (inode_write_at(idx, &h, sizeof h, 0) != sizeof h)
+      return false;
+  }
+  s.hash = hash;
+  s.entry = ofs / sizeof(struct dir_entry) + 1;
+  return inode_write_at(idx, &s, sizeof s, slot_ofs(i)) == sizeof s;
+}
+
+/* Deletes the slot for the entry at offset OFS, whose name hashes
+   to HASH, from index IDX. */
+static bool index_delete(struct inode* idx, uint32_t hash, off_t ofs) {
+  uint32_t entry = ofs / sizeof(struct dir_entry) + 1;
+  struct index_header h;
+  struct index_slot s;
+  size_t i, n;
+
+  if (inode_read_at(idx, &h, sizeof h, 0) != sizeof h)
+    return false;
+  for (i = hash & (h.slot_cnt - 1), n = 0; n < h.slot_cnt; i = (i + 1) & (h.slot_cnt - 1), n++) {
+    if (inode_read_at(idx, &s, sizeof s, slot_ofs(i)) != sizeof s || s.entry == SLOT_EMPTY)
+      return false;
+    if (s.entry == entry) {
+      s.entry = SLOT_DELETED;
+      return inode_write_at(idx, &s, sizeof s, slot_ofs(i)) == sizeof s;
+    }
+  }
+  return false;
+}
+
+/* Opens the index inode in SECTOR.  Index contents are metadata,
+   so writes to them go through the journal. */
+static struct inode* index_open(block_sector_t sector) {
+  struct inode* idx = inode_open(sector);
+  if (idx != NULL)
+    inode_set_journaled(idx);
+  return idx;
+}
+
+/* Deletes the index inode in SECTOR, if SECTOR is not 0. */
+static void index_discard(block_sector_t sector) {
+  struct inode* idx;
+
+  if (sector == 0)
+    return;
+  idx = inode_open(sector);
+  if (idx != NULL) {
+    inode_remove(idx);
+    inode_close(idx);
+  }
+}
+
+/* Builds a fresh index for DIR with room for twice its entries and
+   replaces DIR's old index, if any, with it.  If that fails, DIR
+   is left without an index and is searched linearly. */
+static void index_rebuild(struct inode* dir) {
+  block_sector_t old = inode_get_dir_index(dir);
+  block_sector_t sector = 0;
+  struct inode* idx = NULL;
+  struct index_header h;
+  struct index_slot empty = {0, SLOT_EMPTY};
+  struct dir_entry e;
+  size_t cnt = 0, goal_ofs;
+  bool success;
+  off_t ofs;
+
+  for (ofs = 0; inode_read_at(dir, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
+    if (e.in_use)
+      cnt++;
+  h.slot_cnt = 16;
+  while (h.slot_cnt < cnt * 2)
+    h.slot_cnt *= 2;
+  h.fill_cnt = 0;
+
+  /* The index is grown by writing its last slot, rather than
+     created at full size, so that its zeroed slots are journaled
+     too. */
+  success = free_map_allocate_inode(free_map_inode_sector(inode_get_inumber(dir), &goal_ofs),
+                                    &sector) &&
+            inode_create(sector, 0, false) && (idx = index_open(sector)) != NULL &&
+            inode_write_at(idx, &empty, sizeof empty, slot_ofs(h.slot_cnt - 1)) == sizeof empty &&
+            inode_write_at(idx, &h, sizeof h, 0) == sizeof h;
+  for (ofs = 0; success && inode_read_at(dir, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
+    if (e.in_use)
+      success = index_insert(idx, hash_string(e.name), ofs);
+
+  if (success)
+    inode_set_dir_index(dir, sector);
+  else {
+    if (idx != NULL)
+      inode_remove(idx);
+    else if (sector != 0)
+      free_map_release_inode(sector);
+    inode_set_dir_index(dir, 0);
+  }
+  inode_close(idx);
+  index_discard(old);
+}
+
+/* Records in DIR's index that the entry for NAME is at offset
+   OFS, first giving DIR an index if it has grown past
+   INDEX_THRESHOLD entry slots. */
+static void index_add(struct inode* dir, const char* name, off_t ofs) {
+  block_sector_t sector = inode_get_dir_index(dir);
+  struct inode* idx;
+  bool success;
+
+  if (sector == 0) {
+    if (inode_length(dir) / sizeof(struct dir_entry) >= INDEX_THRESHOLD)
+      index_rebuild(dir);
+    return;
+  }
+  idx = index_open(sector);
+  success = idx != NULL && index_insert(idx, hash_string(name), ofs);
+  inode_close(idx);
+  if (!success)
+    index_rebuild(dir);
+}
+
+/* Removes the entry for NAME at offset OFS from DIR's index, if
+   DIR has one. */
+static void index_remove(struct inode* dir, const char* name, off_t ofs) {
+  block_sector_t sector = inode_get_dir_index(dir);
+  struct inode* idx;
+  bool success;
+
+  if (sector == 0)
+    return;
+  idx = index_open(sector);
+  success = idx != NULL && index_delete(idx, hash_string(name), ofs);
+  inode_close(idx);
+  if (!success)
+    index_rebuild(dir);
+}
+
+/* Returns directory inode DIR's free slot bookkeeping, counting
+   its free slots first if that has not been done since DIR was
+   opened. */
+static struct dir_slots* get_slots(struct inode* dir) {
+  struct dir_slots* s = inode_dir_slots(dir);
+  struct dir_entry e;
+  off_t ofs;
+
+  if (s->free_cnt < 0) {
+    s->free_cnt = 0;
+    s->hint = inode_length(dir);
+    for (ofs = 0; inode_read_at(dir, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
+      if (!e.in_use) {
+        if (s->free_cnt++ == 0)
+          s->hint = ofs;
+      }
+  }
+  return s;
+}
+
+/* Moves entry E of directory inode DIR from byte offset FROM to
+   the free slot at TO, writing the copy before freeing the
+   original so that E is never missing.  If freeing the original
+   fails, frees the copy again.  Returns true if E moved. */
+static bool move_entry(struct inode* dir, struct dir_entry* e, off_t from, off_t to) {
+  bool moved;
+
+  if (inode_write_at(dir, e, sizeof *e, to) != sizeof *e)
+    return false;
+  e->in_use = false;
+  moved = inode_write_at(dir, e, sizeof *e, from) == sizeof *e;
+  if (!moved)
+    inode_write_at(dir, e, sizeof *e, to);
+  e->in_use = true;
+  return moved;
+}
+
+/* Rewrites directory inode DIR with its entries packed at the
+   start, in their existing order, and shrinks it to fit.  Moved
+   entries are dropped from the directory entry cache and the
+   index is rebuilt, or dropped if DIR is now small.  If a write
+   fails, stops with every entry still present exactly once and
+   DIR only partly packed, and leaves its free slots to be
+   recounted.  A readdir in progress through another handle may
+   skip or repeat entries that moved. */
+static void compact(struct inode* dir) {
+  block_sector_t sector = inode_get_inumber(dir);
+  struct dir_slots* s = inode_dir_slots(dir);
+  struct dir_entry e;
+  off_t from, to = 0;
+  bool done = true;
+
+  for (from = 0; inode_read_at(dir, &e, sizeof e, from) == sizeof e; from += sizeof e) {
+    if (!e.in_use)
+      continue;
+    if (from != to) {
+      if (!move_entry(dir, &e, from, to)) {
+        done = false;
+        break;
+      }
+      dcache_invalidate(sector, e.name);
+    }
+    to += sizeof e;
+  }
+
+  if (done) {
+    inode_truncate(dir, to);
+    s->hint = to;
+    s->free_cnt = 0;
+  } else
+    s->free_cnt = -1;
+
+  if (inode_get_dir_index(dir) != 0) {
+    if (done && to / sizeof e < INDEX_THRESHOLD) {
+      index_discard(inode_get_dir_index(dir));
+      inode_set_dir_index(dir, 0);
+    } else
+      index_rebuild(dir);
+  }
+}
+
+/* Searches directory inode DIR, through its index if it has one,
+   for an entry named NAME.  If found, stores the entry into *EP
+   and its byte offset into *OFSP and returns true. */
+static bool search_entry(struct inode* dir, const char* name, struct dir_entry* ep, off_t* ofsp) {
+  block_sector_t sector = inode_get_dir_index(dir);
+  off_t ofs;
+
+  if (sector != 0) {
+    struct inode* idx = inode_open(sector);
+    bool found = idx != NULL && index_find(dir, idx, name, ep, ofsp);
+    inode_close(idx);
+    return found;
+  }
+
+  for (ofs = 0; inode_read_at(dir, ep, sizeof *ep, ofs) == sizeof *ep; ofs += sizeof *ep)
+    if (ep->in_use && !strcmp(name, ep->name)) {
+      *ofsp = ofs;
+      return true;
+    }
+  return false;
+}
+
+/* A path walk in progress: the directory being searched.  Its
+   inode is only opened when the directory entry cache cannot
+   answer, and the working directory's inode is borrowed rather
+   than reopened. */
+struct walk {
+  block_sector_t sector; /* Sector of the directory. */
+  struct inode* inode;   /* Its inode, or null if not opened yet. */
+  bool owned;            /* Was INODE opened by the walk? */
+};
+
+/* Starts W at the directory that NAME is resolved from when given
+   DIR: the root for absolute names, and for relative names the
+   process's working directory if DIR is the root, since callers
+   pass the root to mean the caller's own namespace, otherwise DIR
+   itself. */
+static void walk_start(struct walk* w, const struct dir* dir, const char* name) {
+  struct dir* cwd = thread_current()->cwd;
+
+  if (name[0] == '/') {
+    w->sector = ROOT_DIR_SECTOR;
+    w->inode = NULL;
+  } else if (inode_get_inumber(dir->inode) == ROOT_DIR_SECTOR && cwd != NULL) {
+    w->sector = inode_get_inumber(cwd->inode);
+    w->inode = cwd->inode;
+  } else {
+    w->sector = inode_get_inumber(dir->inode);
+    w->inode = dir->inode;
+  }
+  w->owned = false;
+}
+
+/* Closes W's inode if the walk opened it. */
+static void walk_release(struct walk* w) {
+  if (w->owned)
+    inode_close(w->inode);
+  w->inode = NULL;
+  w->owned = false;
+}
+
+/* Moves W into the directory that E names.  Returns false if E is
+   not a directory. */
+static bool walk_enter(struct walk* w, const struct dir_entry* e) {
+  if (!e->is_dir)
+    return false;
+  walk_release(w);
+  w->sector = e->inode_sector;
+  return true;
+}
+
+/* Returns W's directory inode, opening it if necessary. */
+static struct inode* walk_inode(struct walk* w) {
+  if (w->inode == NULL) {
+    w->inode = inode_open(w->sector);
+    w->owned = w->inode != NULL;
+  }
+  return w->inode;
+}
+
+/* Returns a new reference to W's directory inode, which the caller
+   must close, and ends the walk. */
+static struct inode* walk_finish(struct walk* w) {
+  struct inode* inode = w->owned ? w->inode : inode_open(w->sector);
+
+  w->inode = NULL;
+  w->owned = false;
+  return inode;
+}
+
+/* Like search_entry() on W's directory, but answers from the
+   directory entry cache when it can, and caches what the search
+   finds, including that NAME does not exist. */
+static bool find_entry(struct walk* w, const char* name, struct dir_entry* ep, off_t* ofsp) {
+  struct dcache_entry ce;
+  unsigned gen;
+  bool found;
+
+  switch (dcache_lookup(w->sector, name, &ce, &gen)) {
+    case DCACHE_NEGATIVE:
+      return false;
+    case DCACHE_HIT:
+      ep->inode_sector = ce.inode_sector;
+      strlcpy(ep->name, name, sizeof ep->name);
+      ep->in_use = true;
+      ep->is_dir = ce.is_dir;
+      *ofsp = ce.ofs;
+      return true;
+    case DCACHE_MISS:
+      break;
+  }
+
+  if (walk_inode(w) == NULL)
+    return false;
+  found = search_entry(w->inode, name, ep, ofsp);
+  if (found) {
+    ce.inode_sector = ep->inode_sector;
+    ce.is_dir = ep->is_dir;
+    ce.ofs = *ofsp;
+  }
+  dcache_insert(w->sector, name, found ? &ce : NULL, gen);
+  return found;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool dir_create(block_sector_t sector, size_t entry_cnt, block_sector_t parent_sector) {
+  /* SECTOR may have held a directory whose names are still cached. */
+  dcache_purge_dir(sector);
+
   bool success = inode_create(sector, (entry_cnt + 2) * sizeof(struct dir_entry), true);
   if (!success)
     return false;
@@ -105,67 +528,89 @@ static int get_next_part(char part[NAME_MAX + 1], const char* src) {
   return src - osrc;
 }
 
-/* Searches DIR for a file with the given NAME.
+/* Searches DIR for a file with the given NAME, which may be a
+   path.
    If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
-static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp) {
+   if EP is non-null, sets *OFSP to the byte offset of the
+   directory entry if OFSP is non-null, and sets *DIRP to the
+   sector of the directory that holds the entry if DIRP is
+   non-null.
+   otherwise, returns false and ignores EP, OFSP and DIRP. */
+static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep, off_t* ofsp,
+                   block_sector_t* dirp) {
+  char part[NAME_MAX + 1];
   struct dir_entry e;
-  size_t ofs;
-
-  // if passed directory is root then check name to figure out absolute path or relative path.
-  // If absolute path continues or else switch to a different dir*
-  // also if we swticehd directories here then we must close.
-  bool close_on_return = false;
-  if (inode_get_inumber(dir_get_inode(dir)) == ROOT_DIR_SECTOR && name[0] != '/') {
-    //printf("dir swap!\n");
-    close_on_return = true;
-    dir = dir_open(inode_open(thread_current()->current_working_dir));
-  }
+  struct walk w;
+  bool found = false;
+  off_t ofs;
+  int nlen;
 
-  //printf("LOOKUP: %s \n", name);
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
-  char part[NAME_MAX + 1];
-  int nlen = get_next_part(part, name);
+
+  /* An empty path names the starting directory itself. */
+  nlen = get_next_part(part, name);
   if (nlen == 0)
-    part[0] = '.', part[1] = NULL;
+    strlcpy(part, ".", sizeof part);
   if (nlen == -1)
     return false;
-  name += nlen;
-  //printf("LOOKUP2: %s\n", part);
-
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e) {
-    //printf("SEE FILE: %s\n", e.name);
-    if (e.in_use && !strcmp(part, e.name)) {
-      int nlen = get_next_part(part, name);
-      if (nlen == 0) {
-        bool sdot = e.name[0] == '.' && e.name[1] == 0;
-        bool ddot = e.name[0] == '.' && e.name[1] == '.' && e.name[2] == 0;
-
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        if (close_on_return)
-          dir_close(dir);
-        return true;
-      }
-      if (nlen > 0 && e.is_dir) {
-        if (close_on_return)
-          dir_close(dir);
-
-        dir = dir_open(inode_open(e.inode_sector));
-        bool ret = lookup(dir, name, ep, ofsp);
-        dir_close(dir);
-        return ret;
-      }
+
+  walk_start(&w, dir, name);
+  for (;;) {
+    name += nlen;
+    if (!find_entry(&w, part, &e, &ofs))
+      break;
+    nlen = get_next_part(part, name);
+    if (nlen == 0) {
+      found = true;
+      break;
     }
+    if (nlen < 0 || !walk_enter(&w, &e))
+      break;
   }
-  if (close_on_return)
-    dir_close(dir);
 
+  if (found) {
+    if (ep != NULL)
+      *ep = e;
+    if (ofsp != NULL)
+      *ofsp = ofs;
+    if (dirp != NULL)
+      *dirp = w.sector;
+  }
+  walk_release(&w);
+  return found;
+}
+
+/* Resolves all but the last component of NAME, starting from DIR
+   as lookup() does.  On success, stores the directory reached into
+   *PARENTP, which the caller must close, and the last component
+   into LAST, and returns true. */
+static bool lookup_parent(const struct dir* dir, const char* name, struct inode** parentp,
+                          char last[NAME_MAX + 1]) {
+  char next[NAME_MAX + 1];
+  struct dir_entry e;
+  struct walk w;
+  off_t ofs;
+  int nlen, next_len;
+
+  nlen = get_next_part(last, name);
+  if (nlen <= 0)
+    return false;
+
+  walk_start(&w, dir, name);
+  for (;;) {
+    name += nlen;
+    next_len = get_next_part(next, name);
+    if (next_len == 0) {
+      *parentp = walk_finish(&w);
+      return *parentp != NULL;
+    }
+    if (next_len < 0 || !find_entry(&w, last, &e, &ofs) || !walk_enter(&w, &e))
+      break;
+    strlcpy(last, next, NAME_MAX + 1);
+    nlen = next_len;
+  }
+  walk_release(&w);
   return false;
 }
 
@@ -179,7 +624,7 @@ bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  if (lookup(dir, name, &e, NULL))
+  if (lookup(dir, name, &e, NULL, NULL))
     *inode = inode_open(e.inode_sector);
   else
     *inode = NULL;
@@ -187,55 +632,21 @@ bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
   return *inode != NULL;
 }
 
-bool subdir_lookup(struct dir* dir, const char* name, struct inode** res, char* temp) {
-  int len = strlen(name);
-  int x = len - 1;
-  while (name[x] != '/' && x > 0)
-    x--;
-
-  if (x == 0) {
-    if (name[x] == '/')
-      x++;
-    for (int i = x; i <= len; i++)
-      temp[i - x] = name[i];
-    if (name[0] == '/')
-      *res = inode_open(ROOT_DIR_SECTOR);
-    else
-      *res = inode_open(inode_get_inumber(dir->inode));
-    return true;
-  }
-
-  int y = x;
-  for (int i = 0; i < x; i++)
-    temp[i] = name[i];
-  temp[x] = NULL;
-  bool sdot = temp[0] == '.' && temp[1] == 0;
-  bool ddot = temp[0] == '.' && temp[1] == '.' && temp[2] == 0;
-
-  struct inode* inode = NULL;
-  //printf("ADD0: %s\n", temp);
-  if (dir != NULL) {
-    if (!dir_lookup(dir, temp, &inode)) {
-      //printf("ADD1: %s\n", temp);
-
-      dir_close(dir);
-      return false;
-    }
-  } else {
-    //printf("ADD2: %s\n", temp);
+/* Returns the sector holding the inode of the directory that
+   dir_add() puts NAME in when given DIR, for use as an allocation
+   goal.  Falls back to DIR itself if NAME's parent cannot be
+   found. */
+block_sector_t dir_parent_sector(const struct dir* dir, const char* name) {
+  block_sector_t inumber = inode_get_inumber(dir->inode);
+  char last[NAME_MAX + 1];
+  struct inode* parent;
+  size_t ofs;
 
-    return false;
+  if (lookup_parent(dir, name, &parent, last)) {
+    inumber = inode_get_inumber(parent);
+    inode_close(parent);
   }
-  if (sdot || ddot || temp[0] == 0)
-    return false;
-
-  *res = inode;
-  if (name[x] == '/')
-    x++;
-  for (int i = x; i <= len; i++)
-    temp[i - x] = name[i];
-
-  return true;
+  return free_map_inode_sector(inumber, &ofs);
 }
 
 /* Adds a file named NAME to DIR, which must not already contain a
@@ -248,37 +659,44 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector, boo
   struct dir_entry e;
   off_t ofs;
   bool success = false;
+  struct inode* inode;
+  char temp[NAME_MAX + 1];
+  struct dir_slots* slots;
+  bool reused;
+  struct walk w;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
-  /* Check NAME for validity. */
-  if (*name == '\0' || strlen(name) > NAME_MAX)
+  /* Find the directory to add to.  Fails if NAME is empty or its
+     last component is too long. */
+  if (!lookup_parent(dir, name, &inode, temp))
+    return false;
+  dir = dir_open(inode);
+  if (dir == NULL)
     return false;
 
   /* Check that NAME is not in use. */
-  if (lookup(dir, name, NULL, NULL))
+  w.sector = inode_get_inumber(dir->inode);
+  w.inode = dir->inode;
+  w.owned = false;
+  if (find_entry(&w, temp, &e, &ofs))
     goto done;
 
-  struct inode* inode;
-  char temp[NAME_MAX + 1];
-  //printf("SADDIT: %s\n", name);
-
-  if (!subdir_lookup(dir, name, &inode, temp))
-    goto done;
-  dir = dir_open(inode);
-
-  //printf("ADDIT: %s %s %d\n", name, temp, inode_get_inumber(dir->inode));
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
-     current end-of-file.
+     current end-of-file.  The search starts at the directory's
+     free slot hint, so it skips the live entries before it.
 
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
+  slots = get_slots(dir->inode);
+  for (ofs = slots->hint; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
     if (!e.in_use)
       break;
+  reused = ofs < inode_length(dir->inode);
 
   /* Write slot. */
   e.in_use = true;
@@ -286,8 +704,15 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector, boo
   strlcpy(e.name, temp, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
-  dir_close(dir);
+  if (success) {
+    if (reused)
+      slots->free_cnt--;
+    slots->hint = ofs + sizeof e;
+    index_add(dir->inode, e.name, ofs);
+    dcache_invalidate(inode_get_inumber(dir->inode), e.name);
+  }
 done:
+  dir_close(dir);
   return success;
 }
 
@@ -297,6 +722,10 @@ done:
 bool dir_remove(struct dir* dir, const char* name) {
   struct dir_entry e;
   struct inode* inode = NULL;
+  struct inode* parent = NULL;
+  block_sector_t parent_sector;
+  struct dir_slots* slots;
+  size_t slot_cnt;
   bool success = false;
   off_t ofs;
 
@@ -304,37 +733,57 @@ bool dir_remove(struct dir* dir, const char* name) {
   ASSERT(name != NULL);
 
   /* Find directory entry. */
-  if (!lookup(dir, name, &e, &ofs))
+  if (!lookup(dir, name, &e, &ofs, &parent_sector))
     goto done;
 
-  if (e.inode_sector == thread_current()->current_working_dir)
+  if (thread_current()->cwd != NULL &&
+      e.inode_sector == inode_get_inumber(thread_current()->cwd->inode))
     goto done;
 
   /* Open inode. */
   inode = inode_open(e.inode_sector);
+  if (inode == NULL)
+    goto done;
 
   if (inode_is_dir(inode)) {
+    struct dir_entry child;
     off_t ofs2;
     // check if directory has any files except . and ..
-    for (ofs2 = 0; inode_read_at(dir->inode, &e, sizeof e, ofs2) == sizeof e; ofs2 += sizeof e)
-      if (e.in_use &&
-          !(e.name[0] == '.' && (e.name[1] == '\0' || (e.name[1] == '.' && e.name[2] == '\0'))))
+    for (ofs2 = 0; inode_read_at(inode, &child, sizeof child, ofs2) == sizeof child;
+         ofs2 += sizeof child)
+      if (child.in_use && !(child.name[0] == '.' &&
+                            (child.name[1] == '\0' || (child.name[1] == '.' && child.name[2] == '\0'))))
         goto done;
   }
 
-  if (inode == NULL)
+  /* Erase directory entry from the directory that holds it. */
+  parent = inode_open(parent_sector);
+  if (parent == NULL)
     goto done;
-
-  /* Erase directory entry. */
+  slots = get_slots(parent);
   e.in_use = false;
-  if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
+  if (inode_write_at(parent, &e, sizeof e, ofs) != sizeof e)
     goto done;
+  index_remove(parent, e.name, ofs);
+  dcache_invalidate(parent_sector, e.name);
+  if (inode_is_dir(inode))
+    dcache_purge_dir(e.inode_sector);
+
+  /* Track the free slot, and compact the directory once it is
+     mostly free slots. */
+  slots->free_cnt++;
+  if (ofs < slots->hint)
+    slots->hint = ofs;
+  slot_cnt = inode_length(parent) / sizeof e;
+  if (slot_cnt >= COMPACT_THRESHOLD && (size_t)slots->free_cnt * 2 > slot_cnt)
+    compact(parent);
 
   /* Remove inode. */
   inode_remove(inode);
   success = true;
 
 done:
+  inode_close(parent);
   inode_close(inode);
   return success;
 }
@@ -377,6 +826,58 @@ bool userprog_readdir(struct file* file, char name[NAME_MAX + 1]) {
   return false;
 }
 
+/* Number of directory entries userprog_getdents() reads from disk
+   at a time. */
+#define GETDENTS_BATCH 16
+
+/* Fills ENTRIES with up to CNT entries of directory FILE, starting
+   at its current position, with each entry's inode number, type
+   and size, skipping "." and "..".  Advances the position past the
+   entries returned.  Returns the number of entries stored, 0 at
+   the end of the directory, or -1 if FILE is not a directory. */
+int userprog_getdents(struct file* file, struct dirent* entries, size_t cnt) {
+  struct inode* inode = file_get_inode(file);
+  struct dir_entry* batch;
+  size_t stored = 0;
+
+  if (!inode_is_dir(inode))
+    return -1;
+  batch = malloc(GETDENTS_BATCH * sizeof *batch);
+  if (batch == NULL)
+    return -1;
+
+  while (stored < cnt) {
+    off_t bytes = inode_read_at(inode, batch, GETDENTS_BATCH * sizeof *batch, file->pos);
+    size_t n = bytes / sizeof *batch;
+    size_t i;
+
+    if (n == 0)
+      break;
+    for (i = 0; i < n && stored < cnt; i++) {
+      struct dir_entry* e = &batch[i];
+      bool sdot = e->name[0] == '.' && e->name[1] == 0;
+      bool ddot = e->name[0] == '.' && e->name[1] == '.' && e->name[2] == 0;
+      struct dirent* d = &entries[stored];
+      struct inode* child;
+
+      file->pos += sizeof *e;
+      if (!e->in_use || sdot || ddot)
+        continue;
+
+      child = inode_open(e->inode_sector);
+      d->d_ino = e->inode_sector;
+      d->d_type = e->is_dir ? DT_DIR : DT_REG;
+      d->d_size = child != NULL ? inode_length(child) : 0;
+      strlcpy(d->d_name, e->name, sizeof d->d_name);
+      inode_close(child);
+      stored++;
+    }
+  }
+
+  free(batch);
+  return stored;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -395,41 +896,50 @@ bool userprog_readdir(struct file* file, char name[NAME_MAX + 1]) {
 //   return *inode != NULL;
 // }
 
+/* Creates a directory named NAME, which may be a path, resolved
+   from the current process's working directory.  Returns true if
+   successful, false on failure. */
 bool mkdir(const char* name) {
-  struct inode* inode;
-  char temp[NAME_MAX + 1];
-  struct dir* dir = dir_open_root();
-  if (!subdir_lookup(dir, name, &inode, temp))
-    return false;
-  dir_close(dir);
-  //printf("Dir found: %d", inode_get_inumber(inode));
-  dir = dir_open(inode);
+  struct dir* root = dir_open_root();
+  struct inode* parent = NULL;
+  char last[NAME_MAX + 1];
   block_sector_t inode_sector = 0;
-  //printf("ADD0: %s\n", temp);
-  if (!free_map_allocate(1, &inode_sector))
-    return false;
-  //printf("ADDIT mk: %d\n", inode_sector);
-  bool suc = dir_add(dir, temp, inode_sector, true);
-  if (suc) {
-    //printf("NOw populating directory\n", inode_sector);
-    suc = dir_create(inode_sector, 2, inode_get_inumber(inode));
+  bool success = false;
+
+  if (root == NULL || !lookup_parent(root, name, &parent, last))
+    goto done;
+  if (!free_map_allocate_inode(free_map_dir_goal(inode_get_inumber(parent)), &inode_sector))
+    goto done;
+  if (!dir_add(root, name, inode_sector, true)) {
+    free_map_release_inode(inode_sector);
+    goto done;
   }
-  dir_close(dir);
-  return suc;
+  success = dir_create(inode_sector, 2, inode_get_inumber(parent));
+
+done:
+  inode_close(parent);
+  dir_close(root);
+  return success;
 }
 
+/* Makes the directory named NAME the current process's working
+   directory.  Returns true if successful, false on failure. */
 bool chdir(const char* name) {
-  struct dir* dir = dir_open_root();
-  struct inode* inode = NULL;
-  bool success = false;
-  if (dir != NULL) {
-    if (dir_lookup(dir, name, &inode)) {
-      thread_current()->current_working_dir = inode_get_inumber(inode);
-      //printf("working dir to %d\n",inode_get_inumber(inode) );
-      inode_close(inode);
-      success = true;
-    }
+  struct dir* root = dir_open_root();
+  struct thread* t = thread_current();
+  struct dir_entry e;
+  struct dir* dir;
+
+  if (root == NULL || !lookup(root, name, &e, NULL, NULL) || !e.is_dir) {
+    dir_close(root);
+    return false;
   }
-  dir_close(dir);
-  return success;
+  dir_close(root);
+
+  dir = dir_open(inode_open(e.inode_sector));
+  if (dir == NULL)
+    return false;
+  dir_close(t->cwd);
+  t->cwd = dir;
+  return true;
 }
\ No newline at end of file
@@ -16,6 +16,7 @@
 #define NAME_MAX 14
 
 struct inode;
+struct dirent;
 
 /* Opening and closing directories. */
 bool dir_create(block_sector_t sector, size_t entry_cnt, block_sector_t parent_sector);
@@ -27,10 +28,12 @@ struct inode* dir_get_inode(struct dir*);
 
 /* Reading and writing. */
 bool dir_lookup(const struct dir*, const char* name, struct inode**);
+block_sector_t dir_parent_sector(const struct dir*, const char* name);
 bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector, bool is_dir);
 bool dir_remove(struct dir*, const char* name);
 bool dir_readdir(struct dir*, char name[NAME_MAX + 1]);
 bool userprog_readdir(struct file* file, char name[NAME_MAX + 1]);
+int userprog_getdents(struct file* file, struct dirent* entries, size_t cnt);
 
 bool mkdir(const char* name);
 bool chdir(const char* name);
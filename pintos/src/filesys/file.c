@@ -14,6 +14,8 @@ struct file* file_open(struct inode* inode, block_sector_t dir_inode_sector) {
     file->dir_inode_sector = dir_inode_sector;
     file->pos = 0;
     file->deny_write = false;
+    file->direct = false;
+    free_map_window_init(&file->window);
     return file;
   } else {
     inode_close(inode);
@@ -32,6 +34,7 @@ struct file* file_reopen(struct file* file, block_sector_t dir_inode) {
 void file_close(struct file* file) {
   if (file != NULL) {
     file_allow_write(file);
+    free_map_window_release(&file->window);
     inode_close(file->inode);
     free(file);
   }
@@ -48,7 +51,7 @@ struct inode* file_get_inode(struct file* file) {
    which may be less than SIZE if end of file is reached.
    Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file* file, void* buffer, off_t size) {
-  off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+  off_t bytes_read = file_read_at(file, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -59,6 +62,8 @@ off_t file_read(struct file* file, void* buffer, off_t size) {
    which may be less than SIZE if end of file is reached.
    The file's current position is unaffected. */
 off_t file_read_at(struct file* file, void* buffer, off_t size, off_t file_ofs) {
+  if (file->direct)
+    return inode_read_at_direct(file->inode, buffer, size, file_ofs);
   return inode_read_at(file->inode, buffer, size, file_ofs);
 }
 
@@ -70,9 +75,7 @@ off_t file_read_at(struct file* file, void* buffer, off_t size, off_t file_ofs)
    not yet implemented.)
    Advances FILE's position by the number of bytes read. */
 off_t file_write(struct file* file, const void* buffer, off_t size) {
-  if (inode_is_dir(file->inode))
-    return -1;
-  off_t bytes_written = inode_write_at(file->inode, buffer, size, file->pos);
+  off_t bytes_written = file_write_at(file, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -83,9 +86,100 @@ off_t file_write(struct file* file, const void* buffer, off_t size) {
    which may be less than SIZE if end of file is reached.
    (Normally we'd grow the file in that case, but file growth is
    not yet implemented.)
-   The file's current position is unaffected. */
+   The file's current position is unaffected.
+   Returns -1 if FILE is a directory, whose entries change only
+   through the directory code. */
 off_t file_write_at(struct file* file, const void* buffer, off_t size, off_t file_ofs) {
-  return inode_write_at(file->inode, buffer, size, file_ofs);
+  if (inode_is_dir(file->inode))
+    return -1;
+  if (file->direct)
+    return inode_write_at_direct(file->inode, buffer, size, file_ofs);
+  return inode_write_at_window(file->inode, buffer, size, file_ofs, &file->window);
+}
+
+/* Makes reads and writes of FILE move whole sectors straight
+   between the caller's buffer and the disk, without the buffer
+   cache, if DIRECT is true, or go through the cache again if
+   false.  Meant for large one-pass transfers that would otherwise
+   push everything else out of the cache. */
+void file_set_direct(struct file* file, bool direct) { file->direct = direct; }
+
+/* Returns true if FILE bypasses the buffer cache. */
+bool file_is_direct(struct file* file) { return file->direct; }
+
+/* Reserves space for LEN bytes of FILE starting at OFFSET,
+   growing FILE if it ends before OFFSET + LEN.  The new sectors
+   are allocated contiguously where possible and read as zeros
+   without being written.  The file's current position is
+   unaffected.  Returns true if successful, false if FILE is a
+   directory or the disk is full. */
+bool file_allocate(struct file* file, off_t offset, off_t len) {
+  if (inode_is_dir(file->inode) || offset < 0 || len <= 0 || offset + len < offset)
+    return false;
+  return inode_preallocate(file->inode, offset + len);
+}
+
+/* Bytes moved per step of file_copy(). */
+#define COPY_CHUNK (8 * BLOCK_SECTOR_SIZE)
+
+/* Copies up to SIZE bytes from SRC, starting at its current
+   position, into DST at its current position, and advances both
+   positions past the bytes copied.  The data moves between the
+   two inodes through the buffer cache and a kernel buffer, never
+   through user memory.  The sectors for the part of DST being
+   grown are reserved in one run before any data is copied, but
+   DST grows only as the data lands, so a short copy leaves
+   nothing to cut back.
+   Returns the number of bytes copied, which is less than SIZE if
+   SRC ends first or DST cannot grow, or -1 if DST is a directory,
+   the two ranges overlap within the same file, or memory is
+   short. */
+off_t file_copy(struct file* dst, struct file* src, off_t size) {
+  off_t avail = inode_length(src->inode) - src->pos;
+  off_t copied = 0;
+  uint8_t* buffer;
+
+  if (inode_is_dir(dst->inode))
+    return -1;
+  if (size > avail)
+    size = avail;
+  if (size <= 0)
+    return 0;
+  if (dst->inode == src->inode && dst->pos < src->pos + size && src->pos < dst->pos + size)
+    return -1;
+  buffer = malloc(COPY_CHUNK);
+  if (buffer == NULL)
+    return -1;
+
+  inode_reserve(dst->inode, dst->pos + size, &dst->window);
+  while (copied < size) {
+    off_t chunk = size - copied < COPY_CHUNK ? size - copied : COPY_CHUNK;
+    off_t n = inode_read_at(src->inode, buffer, chunk, src->pos + copied);
+
+    if (n > 0)
+      n = inode_write_at_window(dst->inode, buffer, n, dst->pos + copied, &dst->window);
+    if (n <= 0)
+      break;
+    copied += n;
+    if (n < chunk)
+      break;
+  }
+
+  src->pos += copied;
+  dst->pos += copied;
+  free(buffer);
+  return copied;
+}
+
+/* Replaces the contents of DST by those of SRC without copying
+   any data: the two files share their data sectors until either
+   one writes them.  Positions are unaffected.  Returns true if
+   successful, false if either file is a directory, they are the
+   same file, DST denies writes, or the disk is full. */
+bool file_clone(struct file* dst, struct file* src) {
+  if (inode_is_dir(dst->inode) || inode_is_dir(src->inode))
+    return false;
+  return inode_clone(dst->inode, src->inode);
 }
 
 /* Prevents write operations on FILE's underlying inode
@@ -4,6 +4,7 @@
 #include "filesys/off_t.h"
 #include "devices/block.h"
 #include <debug.h>
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "devices/block.h"
@@ -15,6 +16,8 @@ struct file {
   block_sector_t dir_inode_sector; /* Directory containing file inode */
   off_t pos;                       /* Current position. */
   bool deny_write;                 /* Has file_deny_write() been called? */
+  bool direct;                     /* Bypass the buffer cache? */
+  struct prealloc_window window;   /* Sectors reserved for appends. */
 };
 
 /* Opening and closing files. */
@@ -28,6 +31,13 @@ off_t file_read(struct file*, void*, off_t);
 off_t file_read_at(struct file*, void*, off_t size, off_t start);
 off_t file_write(struct file*, const void*, off_t);
 off_t file_write_at(struct file*, const void*, off_t size, off_t start);
+off_t file_copy(struct file* dst, struct file* src, off_t size);
+bool file_allocate(struct file*, off_t offset, off_t len);
+bool file_clone(struct file* dst, struct file* src);
+
+/* Uncached I/O. */
+void file_set_direct(struct file*, bool);
+bool file_is_direct(struct file*);
 
 /* Preventing writes. */
 void file_deny_write(struct file*);
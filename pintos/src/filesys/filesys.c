@@ -2,10 +2,12 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
 #include "filesys/sector_cache.h"
 
 /* Partition that contains the file system. */
@@ -24,6 +26,8 @@ void filesys_init(bool format) {
   cache_init(&filesys_cache);
 
   inode_init();
+  dcache_init();
+  journal_init();
   free_map_init();
 
   if (format)
@@ -36,6 +40,8 @@ void filesys_init(bool format) {
    to disk. */
 void filesys_done(void) {
   //flush cache
+  inode_reclaim_wait();
+  journal_sync();
   free_map_close();
 
   block_cache_flush(fs_device);
@@ -49,10 +55,10 @@ bool filesys_create(const char* name, off_t initial_size) {
   block_sector_t inode_sector = 0;
   struct dir* dir = dir_open_root();
   bool success =
-      (dir != NULL && free_map_allocate(1, &inode_sector) &&
+      (dir != NULL && free_map_allocate_inode(dir_parent_sector(dir, name), &inode_sector) &&
        inode_create(inode_sector, initial_size, false) && dir_add(dir, name, inode_sector, false));
   if (!success && inode_sector != 0)
-    free_map_release(inode_sector, 1);
+    free_map_release_inode(inode_sector);
   dir_close(dir);
 
   return success;
@@ -93,12 +99,14 @@ bool filesys_remove(const char* name) {
   return success;
 }
 
-/* Formats the file system. */
+/* Formats the file system.  free_map_create() also picks the
+   block group layout and records it in the super block. */
 static void do_format(void) {
   printf("Formatting file system...");
   free_map_create();
   if (!dir_create(ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC("root directory creation failed");
+  journal_sync();
   free_map_close();
   printf("done.\n");
 }
@@ -5,9 +5,10 @@
 #include "filesys/off_t.h"
 #include "filesys/sector_cache.h"
 
-/* Sectors of system file inodes. */
-#define FREE_MAP_SECTOR 0 /* Free map file inode sector. */
-#define ROOT_DIR_SECTOR 1 /* Root directory file inode sector. */
+/* Inode numbers of system files, and the super block sector. */
+#define FREE_MAP_SECTOR 0 /* Free map file inode number. */
+#define ROOT_DIR_SECTOR 1 /* Root directory file inode number. */
+#define SUPER_SECTOR 2    /* Super block sector. */
 
 /* Block device that contains the file system. */
 struct block* fs_device;
@@ -1,60 +1,640 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <round.h>
+#include <stdint.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file* free_map_file; /* Free map file. */
 static struct bitmap* free_map;    /* Free map, one bit per sector. */
+static struct lock free_map_lock;  /* Protects free_map and dirty_map. */
+
+/* Sectors of the free map file that differ from the disk, one bit
+   per sector.  Changes to the free map only mark bits here; the
+   sectors are written by free_map_flush(). */
+static struct bitmap* dirty_map;
+
+/* Reference counts of data sectors shared between copy-on-write
+   clones, one byte per sector alongside the free map: the number
+   of block map pointers to the sector beyond the first, so 0 for
+   every sector that is free or has a single owner.  Releasing a
+   shared sector only drops one reference.  Kept in the refcount
+   file, whose changed sectors are tracked in REFCOUNT_DIRTY and
+   written by free_map_flush() like those of the free map.  Also
+   protected by free_map_lock. */
+static struct file* refcount_file; /* Refcount file, or null if none. */
+static uint8_t* refcounts;          /* Reference counts. */
+static struct bitmap* refcount_dirty;
+
+/* Most references a sector can have beyond the first. */
+#define REFCOUNT_MAX UINT8_MAX
+
+/* Inodes are packed INODES_PER_SECTOR to a sector in an inode
+   table at the start of each block group, which has a slot for
+   every SECTORS_PER_INODE sectors of the group.  Inode number N is
+   slot N % INODES_PER_GROUP of group N / INODES_PER_GROUP's table,
+   so that an inode lives in the same group as its data, and
+   looking up the files of one directory touches a few table
+   sectors instead of one sector per file.  Which slots are in use
+   is kept in the inode map, one bit per slot, stored in the inode
+   map file and flushed like the free map.  Also protected by
+   free_map_lock.
+
+   A disk formatted without inode tables stores each inode at the
+   start of a sector of its own, whose number is the inode
+   number; then INODES_PER_GROUP is 0 and there is no inode map. */
+#define INODES_PER_SECTOR (BLOCK_SECTOR_SIZE / INODE_DISK_SIZE)
+#define SECTORS_PER_INODE 8
+static size_t inodes_per_group;       /* Inode slots per group, or 0. */
+static struct bitmap* inode_map;      /* Inode slots in use. */
+static struct bitmap* inode_dirty;    /* Changed sectors of inode map file. */
+static struct file* inode_map_file;   /* Inode map file. */
+
+/* Identifies a super block. */
+#define SUPER_MAGIC 0x53555052
+
+/* Largest block group, in sectors: as many as one sector of the
+   free map describes, as in ext2. */
+#define MAX_GROUP_SIZE (BLOCK_SECTOR_SIZE * CHAR_BIT)
+
+/* Smallest block group, in sectors. */
+#define MIN_GROUP_SIZE 64
+
+/* Number of groups that small disks are split into, so that they
+   still benefit from grouping. */
+#define MIN_GROUP_CNT 8
+
+/* On-disk super block, in sector SUPER_SECTOR.  Records the block
+   group layout chosen when the disk was formatted and where the
+   metadata journal is.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct super_block {
+  unsigned magic;               /* Magic number. */
+  uint32_t group_size;          /* Sectors per block group. */
+  block_sector_t journal_start; /* First journal sector, or 0 if none. */
+  block_sector_t refcount_inode;  /* Refcount file inode number, or 0. */
+  uint32_t inodes_per_group;       /* Inode table slots per group, or 0. */
+  block_sector_t inode_map_inode;  /* Inode map file inode number. */
+  uint32_t unused[122];            /* Not used. */
+};
+
+/* The disk is split into block groups of GROUP_SIZE consecutive
+   sectors (the last one may be shorter).  An inode and its data
+   are allocated in the group of the directory that holds it, so
+   that related sectors stay close together. */
+static size_t group_size;   /* Sectors per group. */
+static size_t group_cnt;    /* Number of groups. */
+static size_t* group_free;  /* Free sectors in each group. */
+
+/* Returns the group that SECTOR belongs to. */
+static inline size_t group_of(block_sector_t sector) { return sector / group_size; }
+
+/* Returns the first sector of group G. */
+static inline block_sector_t group_start(size_t g) { return g * group_size; }
+
+/* Returns the sector just past the end of group G. */
+static inline block_sector_t group_end(size_t g) {
+  size_t end = (g + 1) * group_size;
+  return end < bitmap_size(free_map) ? end : bitmap_size(free_map);
+}
+
+/* Returns the first sector of group G's inode table, which in
+   group 0 comes after the super block. */
+static inline block_sector_t table_start(size_t g) {
+  return g == 0 ? SUPER_SECTOR + 1 : group_start(g);
+}
+
+/* Returns the number of sectors in each group's inode table. */
+static inline size_t table_sectors(void) {
+  return DIV_ROUND_UP(inodes_per_group, INODES_PER_SECTOR);
+}
+
+/* Adds DELTA to the free counts of the groups holding sectors
+   START through START + CNT - 1.
+   free_map_lock must be held. */
+static void count_free(block_sector_t start, size_t cnt, int delta) {
+  while (cnt > 0) {
+    size_t g = group_of(start);
+    size_t n = group_end(g) - start < cnt ? group_end(g) - start : cnt;
+
+    group_free[g] += delta * (int)n;
+    start += n;
+    cnt -= n;
+  }
+}
+
+/* Splits the disk into groups of SIZE sectors and counts the free
+   sectors in each one. */
+static void set_groups(size_t size) {
+  size_t g;
+
+  group_size = size;
+  group_cnt = DIV_ROUND_UP(bitmap_size(free_map), size);
+  free(group_free);
+  group_free = malloc(group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC("can't allocate block group table");
+  for (g = 0; g < group_cnt; g++) {
+    size_t used = bitmap_count(free_map, group_start(g), group_end(g) - group_start(g), true);
+    group_free[g] = group_end(g) - group_start(g) - used;
+  }
+}
+
+/* Marks the free map file sectors that hold the bits for sectors
+   START through START + CNT - 1 as dirty.
+   free_map_lock must be held. */
+static void mark_dirty(block_sector_t start, size_t cnt) {
+  size_t first = start / CHAR_BIT / BLOCK_SECTOR_SIZE;
+  size_t last = (start + cnt - 1) / CHAR_BIT / BLOCK_SECTOR_SIZE;
+
+  if (cnt > 0)
+    bitmap_set_multiple(dirty_map, first, last - first + 1, true);
+}
 
 /* Initializes the free map. */
 void free_map_init(void) {
+  lock_init(&free_map_lock);
   free_map = bitmap_create(block_size(fs_device));
   if (free_map == NULL)
     PANIC("bitmap creation failed--file system device is too large");
+  dirty_map = bitmap_create(DIV_ROUND_UP(bitmap_file_size(free_map), BLOCK_SECTOR_SIZE));
+  if (dirty_map == NULL)
+    PANIC("bitmap creation failed--file system device is too large");
+  refcounts = calloc(1, bitmap_size(free_map));
+  refcount_dirty = bitmap_create(DIV_ROUND_UP(bitmap_size(free_map), BLOCK_SECTOR_SIZE));
+  if (refcounts == NULL || refcount_dirty == NULL)
+    PANIC("refcount creation failed--file system device is too large");
   bitmap_mark(free_map, FREE_MAP_SECTOR);
   bitmap_mark(free_map, ROOT_DIR_SECTOR);
+  bitmap_mark(free_map, SUPER_SECTOR);
+  set_groups(bitmap_size(free_map));
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map, as close
+   after GOAL as possible, and stores the first into *SECTORP.
+   The search covers GOAL's block group first, then the following
+   groups that have enough free sectors, wrapping around, and
+   finally runs that straddle groups.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
-bool free_map_allocate(size_t cnt, block_sector_t* sectorp) {
-  block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file)) {
-    bitmap_set_multiple(free_map, sector, cnt, false);
-    sector = BITMAP_ERROR;
+   sectors were available. */
+bool free_map_allocate_near(size_t cnt, block_sector_t goal, block_sector_t* sectorp) {
+  size_t sector = BITMAP_ERROR;
+  size_t first, i;
+
+  if (goal >= bitmap_size(free_map))
+    goal = 0;
+  first = group_of(goal);
+
+  lock_acquire(&free_map_lock);
+  for (i = 0; i < group_cnt && sector == BITMAP_ERROR; i++) {
+    size_t g = (first + i) % group_cnt;
+    if (group_free[g] < cnt)
+      continue;
+    if (i == 0)
+      sector = bitmap_scan_range(free_map, goal, group_end(g), cnt, false);
+    if (sector == BITMAP_ERROR)
+      sector = bitmap_scan_range(free_map, group_start(g), group_end(g), cnt, false);
+  }
+  if (sector == BITMAP_ERROR)
+    sector = bitmap_scan(free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR) {
+    bitmap_set_multiple(free_map, sector, cnt, true);
+    count_free(sector, cnt, -1);
+    mark_dirty(sector, cnt);
   }
+  lock_release(&free_map_lock);
+
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Allocates CNT consecutive sectors from the free map and stores
+   the first into *SECTORP.
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+bool free_map_allocate(size_t cnt, block_sector_t* sectorp) {
+  return free_map_allocate_near(cnt, 0, sectorp);
+}
+
+/* Returns an allocation goal for a new directory created in the
+   directory whose inode number is PARENT: the start of the block
+   group with the most free sectors.  Spreading directories this
+   way leaves room in each group for the files that will be
+   created in it.  Ties go to the first group after PARENT's. */
+block_sector_t free_map_dir_goal(block_sector_t parent) {
+  size_t ofs;
+  block_sector_t sector = free_map_inode_sector(parent, &ofs);
+  size_t first = group_of(sector < bitmap_size(free_map) ? sector : 0);
+  size_t best = (first + 1) % group_cnt;
+  size_t i;
+
+  lock_acquire(&free_map_lock);
+  for (i = 2; i <= group_cnt; i++) {
+    size_t g = (first + i) % group_cnt;
+    if (group_free[g] > group_free[best])
+      best = g;
+  }
+  lock_release(&free_map_lock);
+  return group_start(best);
+}
+
+/* Drops one reference to in-use SECTOR and returns true if that
+   was the last one, so that SECTOR becomes free.
+   free_map_lock must be held. */
+static bool drop_ref(block_sector_t sector) {
+  ASSERT(bitmap_test(free_map, sector));
+  if (refcounts[sector] == 0)
+    return true;
+  refcounts[sector]--;
+  bitmap_mark(refcount_dirty, sector / BLOCK_SECTOR_SIZE);
+  return false;
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, except
+   for those still shared with a clone, which just lose a
+   reference. */
 void free_map_release(block_sector_t sector, size_t cnt) {
-  ASSERT(bitmap_all(free_map, sector, cnt));
-  bitmap_set_multiple(free_map, sector, cnt, false);
-  bitmap_write(free_map, free_map_file);
+  size_t i;
+
+  lock_acquire(&free_map_lock);
+  for (i = 0; i < cnt; i++)
+    if (drop_ref(sector + i)) {
+      bitmap_reset(free_map, sector + i);
+      count_free(sector + i, 1, 1);
+    }
+  mark_dirty(sector, cnt);
+  lock_release(&free_map_lock);
+}
+
+/* Makes each of the CNT sectors in SECTORS available for use,
+   except for those still shared with a clone, which just lose a
+   reference. */
+void free_map_release_batch(const block_sector_t sectors[], size_t cnt) {
+  size_t i;
+
+  lock_acquire(&free_map_lock);
+  for (i = 0; i < cnt; i++)
+    if (drop_ref(sectors[i])) {
+      bitmap_reset(free_map, sectors[i]);
+      group_free[group_of(sectors[i])]++;
+      mark_dirty(sectors[i], 1);
+    }
+  lock_release(&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Adds a reference to in-use data SECTOR, which a copy-on-write
+   clone is about to point at as well.  Returns true if
+   successful, false if SECTOR has too many references already or
+   the file system has no refcount file. */
+bool free_map_share(block_sector_t sector) {
+  bool success;
+
+  lock_acquire(&free_map_lock);
+  ASSERT(bitmap_test(free_map, sector));
+  success = refcount_file != NULL && refcounts[sector] < REFCOUNT_MAX;
+  if (success) {
+    refcounts[sector]++;
+    bitmap_mark(refcount_dirty, sector / BLOCK_SECTOR_SIZE);
+  }
+  lock_release(&free_map_lock);
+  return success;
+}
+
+/* Returns the sector that holds on-disk inode INUMBER, and stores
+   the inode's byte offset within it into *OFSP. */
+block_sector_t free_map_inode_sector(block_sector_t inumber, size_t* ofsp) {
+  size_t slot;
+
+  if (inodes_per_group == 0) {
+    *ofsp = 0;
+    return inumber;
+  }
+  slot = inumber % inodes_per_group;
+  *ofsp = slot % INODES_PER_SECTOR * INODE_DISK_SIZE;
+  return table_start(inumber / inodes_per_group) + slot / INODES_PER_SECTOR;
+}
+
+/* Marks inode slots START through START + CNT - 1 as in use if
+   USED is true, or free if it is false.
+   free_map_lock must be held. */
+static void set_inodes(size_t start, size_t cnt, bool used) {
+  size_t unit = BLOCK_SECTOR_SIZE * CHAR_BIT;
+
+  bitmap_set_multiple(inode_map, start, cnt, used);
+  if (cnt > 0)
+    bitmap_set_multiple(inode_dirty, start / unit, (start + cnt - 1) / unit - start / unit + 1,
+                        true);
+}
+
+/* Allocates an inode, stored as close after sector GOAL as
+   possible: in the inode table of GOAL's block group, or of the
+   first group after it with a free slot, wrapping around.  On a
+   disk without inode tables, allocates a sector near GOAL to hold
+   it instead.  Stores the new inode number into *INUMBERP.
+   Returns true if successful, false if every slot is in use. */
+bool free_map_allocate_inode(block_sector_t goal, block_sector_t* inumberp) {
+  size_t slot;
+
+  if (inodes_per_group == 0)
+    return free_map_allocate_near(1, goal, inumberp);
+  if (goal >= bitmap_size(free_map))
+    goal = 0;
+
+  lock_acquire(&free_map_lock);
+  slot = bitmap_scan(inode_map, group_of(goal) * inodes_per_group, 1, false);
+  if (slot == BITMAP_ERROR)
+    slot = bitmap_scan(inode_map, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    set_inodes(slot, 1, true);
+  lock_release(&free_map_lock);
+
+  if (slot != BITMAP_ERROR)
+    *inumberp = slot;
+  return slot != BITMAP_ERROR;
+}
+
+/* Makes inode INUMBER available for reuse. */
+void free_map_release_inode(block_sector_t inumber) {
+  if (inodes_per_group == 0) {
+    free_map_release(inumber, 1);
+    return;
+  }
+  lock_acquire(&free_map_lock);
+  ASSERT(bitmap_test(inode_map, inumber));
+  set_inodes(inumber, 1, false);
+  lock_release(&free_map_lock);
+}
+
+/* Returns true if SECTOR is pointed at by more than one block
+   map, so that it must be copied before it is written. */
+bool free_map_is_shared(block_sector_t sector) {
+  bool shared;
+
+  lock_acquire(&free_map_lock);
+  shared = refcounts[sector] > 0;
+  lock_release(&free_map_lock);
+  return shared;
+}
+
+/* Smallest and largest preallocation windows, in sectors. */
+#define WINDOW_MIN 8
+#define WINDOW_MAX 64
+
+/* Initializes W as an empty window. */
+void free_map_window_init(struct prealloc_window* w) {
+  w->next = 0;
+  w->cnt = 0;
+  w->size = WINDOW_MIN;
+}
+
+/* Allocates one sector through W and stores it into *SECTORP.  If
+   W is empty, first reserves a new run of free sectors near GOAL,
+   twice as long as the previous one up to WINDOW_MAX, or shorter
+   if no run that long is free.
+   Returns true if successful, false if the disk is full. */
+bool free_map_window_take(struct prealloc_window* w, block_sector_t goal, block_sector_t* sectorp) {
+  if (w->cnt == 0) {
+    size_t size;
+
+    for (size = w->size; size > 0; size /= 2)
+      if (free_map_allocate_near(size, goal, &w->next))
+        break;
+    if (size == 0)
+      return false;
+    w->cnt = size;
+    if (w->size < WINDOW_MAX)
+      w->size *= 2;
+  }
+
+  *sectorp = w->next++;
+  w->cnt--;
+  return true;
+}
+
+/* Returns the sectors still reserved in W to the free map. */
+void free_map_window_release(struct prealloc_window* w) {
+  if (w->cnt > 0)
+    free_map_release(w->next, w->cnt);
+  w->cnt = 0;
+  w->size = WINDOW_MIN;
+}
+
+/* Writes the sectors of bitmap MAP's FILE whose bits are set in
+   DIRTY, and clears them.  Returns true if successful, false
+   otherwise.
+   free_map_lock must be held. */
+static bool write_dirty(struct bitmap* map, struct bitmap* dirty, struct file* file) {
+  size_t size = bitmap_file_size(map);
+  size_t i;
+  bool success = true;
+
+  for (i = 0; i < bitmap_size(dirty); i++) {
+    size_t ofs = i * BLOCK_SECTOR_SIZE;
+    size_t chunk = size - ofs < BLOCK_SECTOR_SIZE ? size - ofs : BLOCK_SECTOR_SIZE;
+
+    if (!bitmap_test(dirty, i))
+      continue;
+    if (bitmap_write_part(map, file, ofs, chunk))
+      bitmap_reset(dirty, i);
+    else
+      success = false;
+  }
+  return success;
+}
+
+/* Writes the sectors of the free map file, the inode map file and
+   the refcount file that changed since the last flush.  Returns
+   true if successful, false otherwise.
+
+   Every journal commit calls this, so that no commit captures a
+   reference to a sector or inode slot without the bit that
+   allocates it.  The flush's own writes may commit the journal,
+   so a call from within a flush, or before the free map file is
+   open, does nothing. */
+bool free_map_flush(void) {
+  size_t size, i;
+  bool success;
+
+  if (free_map_file == NULL || lock_held_by_current_thread(&free_map_lock))
+    return true;
+  lock_acquire(&free_map_lock);
+  success = write_dirty(free_map, dirty_map, free_map_file);
+  if (inode_map_file != NULL && !write_dirty(inode_map, inode_dirty, inode_map_file))
+    success = false;
+
+  size = bitmap_size(free_map);
+  for (i = 0; refcount_file != NULL && i < bitmap_size(refcount_dirty); i++) {
+    size_t ofs = i * BLOCK_SECTOR_SIZE;
+    size_t chunk = size - ofs < BLOCK_SECTOR_SIZE ? size - ofs : BLOCK_SECTOR_SIZE;
+
+    if (!bitmap_test(refcount_dirty, i))
+      continue;
+    if (file_write_at(refcount_file, refcounts + ofs, chunk, ofs) == (off_t)chunk)
+      bitmap_reset(refcount_dirty, i);
+    else
+      success = false;
+  }
+  lock_release(&free_map_lock);
+  return success;
+}
+
+/* Opens and returns the file whose inode is INUMBER, which holds
+   file system metadata described by WHAT, so that its writes go
+   through the journal like those of the free map file. */
+static struct file* meta_open(block_sector_t inumber, const char* what) {
+  struct file* file = file_open(inode_open(inumber), 0);
+  if (file == NULL)
+    PANIC("can't open %s", what);
+  inode_set_journaled(file_get_inode(file));
+  return file;
+}
+
+/* Sets up the inode tables for groups of SIZE sectors, with
+   INODES slots each, and creates an empty inode map for them. */
+static void set_inode_tables(size_t size, size_t inodes) {
+  size_t cnt = DIV_ROUND_UP(bitmap_size(free_map), size) * inodes;
+
+  group_size = size;
+  inodes_per_group = inodes;
+  bitmap_destroy(inode_map);
+  bitmap_destroy(inode_dirty);
+  inode_map = bitmap_create(cnt);
+  inode_dirty = bitmap_create(DIV_ROUND_UP(bitmap_file_size(inode_map), BLOCK_SECTOR_SIZE));
+  if (inode_map == NULL || inode_dirty == NULL)
+    PANIC("inode map creation failed--file system device is too large");
+}
+
+/* Opens the free map file and reads it from disk, along with the
+   block group layout from the super block.  A disk without a
+   super block is treated as a single group.  If the super block
+   names a journal, it is replayed first, before any metadata is
+   read.  If it records inode tables, the inode map is read;
+   otherwise every inode has a sector of its own.  If it names a
+   refcount file, the reference counts of shared sectors are read
+   from it; otherwise clones cannot be made. */
 void free_map_open(void) {
+  struct super_block* sb;
+  bool valid;
+
+  sb = malloc(sizeof *sb);
+  if (sb == NULL)
+    PANIC("can't read super block");
+  block_read(fs_device, SUPER_SECTOR, sb);
+  valid = sb->magic == SUPER_MAGIC && sb->group_size >= MIN_GROUP_SIZE;
+  if (valid && sb->journal_start != 0)
+    journal_open(sb->journal_start);
+
+  /* Inodes can only be found once the inode tables are known. */
+  if (valid && sb->inodes_per_group != 0)
+    set_inode_tables(sb->group_size, sb->inodes_per_group);
+
   free_map_file = file_open(inode_open(FREE_MAP_SECTOR), 0);
   if (free_map_file == NULL)
     PANIC("can't open free map");
   if (!bitmap_read(free_map, free_map_file))
     PANIC("can't read free map");
+
+  if (inodes_per_group != 0) {
+    inode_map_file = meta_open(sb->inode_map_inode, "inode map");
+    if (!bitmap_read(inode_map, inode_map_file))
+      PANIC("can't read inode map");
+  }
+
+  if (valid && sb->refcount_inode != 0) {
+    refcount_file = meta_open(sb->refcount_inode, "refcount file");
+    if (file_read_at(refcount_file, refcounts, bitmap_size(free_map), 0) !=
+        (off_t)bitmap_size(free_map))
+      PANIC("can't read refcount file");
+  }
+
+  set_groups(valid ? sb->group_size : bitmap_size(free_map));
+  free(sb);
+}
+
+/* Writes the free map to disk and closes the free map file, the
+   inode map file and the refcount file. */
+void free_map_close(void) {
+  free_map_flush();
+  file_close(free_map_file);
+  file_close(inode_map_file);
+  file_close(refcount_file);
+  inode_map_file = refcount_file = NULL;
 }
 
-/* Writes the free map to disk and closes the free map file. */
-void free_map_close(void) { file_close(free_map_file); }
+/* Picks the block group size for a new file system: groups as
+   large as one free map sector covers, but at least MIN_GROUP_CNT
+   of them on small disks. */
+static size_t choose_group_size(void) {
+  size_t size = MAX_GROUP_SIZE;
+
+  while (size > MIN_GROUP_SIZE && bitmap_size(free_map) / size < MIN_GROUP_CNT)
+    size /= 2;
+  return size;
+}
 
 /* Creates a new free map file on disk and writes the free map to
-   it. */
+   it, and writes a super block recording a newly chosen block
+   group layout with an inode table in each group, a newly created
+   journal, and newly created inode map and all-zero refcount
+   files. */
 void free_map_create(void) {
+  struct super_block* sb;
+  size_t g;
+
+  /* Choose and record the block group layout. */
+  sb = calloc(1, sizeof *sb);
+  if (sb == NULL)
+    PANIC("super block creation failed");
+  ASSERT(sizeof *sb == BLOCK_SECTOR_SIZE);
+  sb->magic = SUPER_MAGIC;
+  sb->group_size = choose_group_size();
+  sb->inodes_per_group = sb->group_size / SECTORS_PER_INODE;
+  set_inode_tables(sb->group_size, sb->inodes_per_group);
+  set_groups(sb->group_size);
+
+  /* Reserve each group's inode table.  A last group too short to
+     hold one gets no inodes.  The free map and the root directory
+     take the first two slots. */
+  for (g = 0; g < group_cnt; g++)
+    if (table_start(g) + table_sectors() <= group_end(g)) {
+      bitmap_set_multiple(free_map, table_start(g), table_sectors(), true);
+      count_free(table_start(g), table_sectors(), -1);
+    } else
+      set_inodes(g * inodes_per_group, inodes_per_group, true);
+  set_inodes(FREE_MAP_SECTOR, 1, true);
+  set_inodes(ROOT_DIR_SECTOR, 1, true);
+
+  /* The free map and root directory inodes are table slots, so
+     sector ROOT_DIR_SECTOR, which free_map_init() reserved for a
+     disk without tables, is free for data.  Sector 0 stays
+     reserved, since a block map pointer of 0 means no block. */
+  bitmap_reset(free_map, ROOT_DIR_SECTOR);
+  count_free(ROOT_DIR_SECTOR, 1, 1);
+
+  /* Create the journal right after group 0's inode table. */
+  if (!free_map_allocate_near(JOURNAL_SECTORS, SUPER_SECTOR + 1, &sb->journal_start))
+    PANIC("journal creation failed");
+  journal_create(sb->journal_start);
+
+  /* Create the inode map and refcount files. */
+  if (!free_map_allocate_inode(0, &sb->inode_map_inode) ||
+      !inode_create(sb->inode_map_inode, bitmap_file_size(inode_map), false))
+    PANIC("inode map creation failed");
+  inode_map_file = meta_open(sb->inode_map_inode, "inode map");
+  if (!free_map_allocate_inode(0, &sb->refcount_inode) ||
+      !inode_create(sb->refcount_inode, bitmap_size(free_map), false))
+    PANIC("refcount file creation failed");
+  refcount_file = meta_open(sb->refcount_inode, "refcount file");
+  block_write(fs_device, SUPER_SECTOR, sb);
+  free(sb);
+
   /* Create inode. */
   if (!inode_create(FREE_MAP_SECTOR, bitmap_file_size(free_map), false))
     PANIC("free map creation failed");
@@ -65,4 +645,8 @@ void free_map_create(void) {
     PANIC("can't open free map");
   if (!bitmap_write(free_map, free_map_file))
     PANIC("can't write free map");
+  bitmap_set_all(dirty_map, false);
+  if (!bitmap_write(inode_map, inode_map_file))
+    PANIC("can't write inode map");
+  bitmap_set_all(inode_dirty, false);
 }
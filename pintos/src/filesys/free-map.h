@@ -5,13 +5,37 @@
 #include <stddef.h>
 #include "devices/block.h"
 
+/* A run of free sectors reserved ahead of the append point of one
+   open file, so that a file written sequentially stays contiguous
+   even while other files grow at the same time.  Reserved sectors
+   are marked in use in the free map until they are handed out or
+   the window is released. */
+struct prealloc_window {
+  block_sector_t next; /* Next reserved sector to hand out. */
+  size_t cnt;          /* Number of reserved sectors left. */
+  size_t size;         /* Number of sectors to reserve next time. */
+};
+
 void free_map_init(void);
 void free_map_read(void);
 void free_map_create(void);
 void free_map_open(void);
 void free_map_close(void);
+bool free_map_flush(void);
 
 bool free_map_allocate(size_t, block_sector_t*);
+bool free_map_allocate_near(size_t, block_sector_t goal, block_sector_t*);
+block_sector_t free_map_dir_goal(block_sector_t parent);
 void free_map_release(block_sector_t, size_t);
+void free_map_release_batch(const block_sector_t[], size_t);
+bool free_map_allocate_inode(block_sector_t goal, block_sector_t* inumberp);
+void free_map_release_inode(block_sector_t inumber);
+block_sector_t free_map_inode_sector(block_sector_t inumber, size_t* ofsp);
+bool free_map_share(block_sector_t);
+bool free_map_is_shared(block_sector_t);
+
+void free_map_window_init(struct prealloc_window*);
+bool free_map_window_take(struct prealloc_window*, block_sector_t goal, block_sector_t*);
+void free_map_window_release(struct prealloc_window*);
 
 #endif /* filesys/free-map.h */
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +10,8 @@
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* List files in the root directory. */
@@ -60,25 +63,116 @@ void fsutil_rm(char** argv) {
     PANIC("%s: delete failed\n", file_name);
 }
 
+/* Sectors of the scratch device read per transfer by
+   fsutil_extract(), and number of such chunks buffered ahead. */
+#define EXTRACT_SECTORS 64
+#define EXTRACT_BUFS 2
+
+/* One chunk of the archive read ahead by extract_reader(). */
+struct extract_buf {
+  uint8_t* data;       /* EXTRACT_SECTORS sectors of the archive. */
+  block_sector_t cnt;  /* Number of sectors read, 0 at device end. */
+};
+
+/* The archive being extracted.  A reader thread fills the buffers
+   in turn from the scratch device while fsutil_extract() writes
+   the previous ones into the file system, so that the two disks
+   work at the same time. */
+struct extract {
+  struct block* src;                      /* Scratch device. */
+  struct extract_buf bufs[EXTRACT_BUFS];  /* Ring of chunks. */
+  struct semaphore empty;                 /* Buffers free to fill. */
+  struct semaphore full;                  /* Buffers filled. */
+  struct semaphore exited;                /* Upped when reader exits. */
+  bool stop;                              /* Reader should exit? */
+
+  /* Used only by fsutil_extract(). */
+  struct extract_buf* cur; /* Buffer being consumed, or NULL. */
+  block_sector_t next;     /* Next sector of CUR to consume. */
+  size_t taken;            /* Number of buffers consumed. */
+};
+
+/* Reader thread for fsutil_extract(): reads the scratch device X
+   from its start into each free buffer in turn, until told to
+   stop or the device ends. */
+static void extract_reader(void* x_) {
+  struct extract* x = x_;
+  block_sector_t sector = 0;
+  size_t i;
+
+  for (i = 0;; i++) {
+    struct extract_buf* b = &x->bufs[i % EXTRACT_BUFS];
+    block_sector_t left = block_size(x->src) - sector;
+
+    sema_down(&x->empty);
+    if (x->stop)
+      break;
+    b->cnt = left < EXTRACT_SECTORS ? left : EXTRACT_SECTORS;
+    if (b->cnt > 0)
+      block_read_multi(x->src, sector, b->cnt, b->data);
+    sector += b->cnt;
+    sema_up(&x->full);
+    if (b->cnt == 0)
+      break;
+  }
+  sema_up(&x->exited);
+}
+
+/* Returns up to MAX sectors of archive X that follow those taken
+   before, in one run, and stores the number of sectors into *CNT.
+   Taking them lets the reader reuse the buffer of the sectors
+   taken before them. */
+static const uint8_t* extract_take(struct extract* x, block_sector_t max, block_sector_t* cnt) {
+  const uint8_t* p;
+
+  if (x->cur == NULL || x->next == x->cur->cnt) {
+    if (x->cur != NULL)
+      sema_up(&x->empty);
+    sema_down(&x->full);
+    x->cur = &x->bufs[x->taken++ % EXTRACT_BUFS];
+    x->next = 0;
+    if (x->cur->cnt == 0)
+      PANIC("ustar archive runs past end of scratch device");
+  }
+  *cnt = x->cur->cnt - x->next < max ? x->cur->cnt - x->next : max;
+  p = x->cur->data + x->next * BLOCK_SECTOR_SIZE;
+  x->next += *cnt;
+  return p;
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.  The archive is read ahead
+   in large chunks by a separate thread.  Each file's space is
+   allocated in one run before its data is written, and its data
+   goes straight to disk in multi-sector writes, bypassing the
+   buffer cache. */
 void fsutil_extract(char** argv UNUSED) {
-  static block_sector_t sector = 0;
-
-  struct block* src;
-  void *header, *data;
+  struct extract* x;
+  void* header;
+  size_t i;
 
   /* Allocate buffers. */
+  x = malloc(sizeof *x);
   header = malloc(BLOCK_SECTOR_SIZE);
-  data = malloc(BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
+  if (x == NULL || header == NULL)
     PANIC("couldn't allocate buffers");
+  for (i = 0; i < EXTRACT_BUFS; i++)
+    x->bufs[i].data = palloc_get_multiple(PAL_ASSERT, EXTRACT_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE);
 
   /* Open source block device. */
-  src = block_get_role(BLOCK_SCRATCH);
-  if (src == NULL)
+  x->src = block_get_role(BLOCK_SCRATCH);
+  if (x->src == NULL)
     PANIC("couldn't open scratch device");
 
+  /* Start reading ahead. */
+  sema_init(&x->empty, EXTRACT_BUFS);
+  sema_init(&x->full, 0);
+  sema_init(&x->exited, 0);
+  x->stop = false;
+  x->cur = NULL;
+  x->taken = 0;
+  thread_create("extract", PRI_DEFAULT, extract_reader, x);
+
   printf("Extracting ustar archive from scratch device "
          "into file system...\n");
 
@@ -86,13 +180,15 @@ void fsutil_extract(char** argv UNUSED) {
     const char* file_name;
     const char* error;
     enum ustar_type type;
+    block_sector_t cnt;
     int size;
 
-    /* Read and parse ustar header. */
-    block_read(src, sector++, header);
+    /* Read and parse ustar header.  It is copied out so that it
+       stays put while its buffer is refilled. */
+    memcpy(header, extract_take(x, 1, &cnt), BLOCK_SECTOR_SIZE);
     error = ustar_parse_header(header, &file_name, &type, &size);
     if (error != NULL)
-      PANIC("bad ustar header in sector %" PRDSNu " (%s)", sector - 1, error);
+      PANIC("bad ustar header (%s)", error);
 
     if (type == USTAR_EOF) {
       /* End of archive. */
@@ -104,17 +200,25 @@ void fsutil_extract(char** argv UNUSED) {
 
       printf("Putting '%s' into the file system...\n", file_name);
 
-      /* Create destination file. */
-      if (!filesys_create(file_name, size))
+      /* Create destination file, and allocate all of its space
+         without zeroing it, since it is about to be written.  The
+         new sectors are UNWRITTEN, and each direct write fills a
+         run of them with one transfer and one block map update. */
+      if (!filesys_create(file_name, 0))
         PANIC("%s: create failed", file_name);
       dst = filesys_open(file_name);
       if (dst == NULL)
         PANIC("%s: open failed", file_name);
+      if (size > 0 && !file_allocate(dst, 0, size))
+        PANIC("%s: allocation of %d bytes failed", file_name, size);
+      file_set_direct(dst, true);
 
       /* Do copy. */
       while (size > 0) {
-        int chunk_size = (size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size);
-        block_read(src, sector++, data);
+        const uint8_t* data = extract_take(x, DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE), &cnt);
+        int chunk_size = cnt * BLOCK_SECTOR_SIZE;
+        if (chunk_size > size)
+          chunk_size = size;
         if (file_write(dst, data, chunk_size) != chunk_size)
           PANIC("%s: write failed with %d bytes unwritten", file_name, size);
         size -= chunk_size;
@@ -125,16 +229,21 @@ void fsutil_extract(char** argv UNUSED) {
     }
   }
 
-  /* Erase the ustar header from the start of the block device,
-     so that the extraction operation is idempotent.  We erase
-     two blocks because two blocks of zeros are the ustar
-     end-of-archive marker. */
+  /* Stop the reader, then erase the ustar header from the start
+     of the block device, so that the extraction operation is
+     idempotent.  We erase two blocks because two blocks of zeros
+     are the ustar end-of-archive marker. */
+  x->stop = true;
+  sema_up(&x->empty);
+  sema_down(&x->exited);
   printf("Erasing ustar archive...\n");
   memset(header, 0, BLOCK_SECTOR_SIZE);
-  block_write(src, 0, header);
-  block_write(src, 1, header);
+  block_write(x->src, 0, header);
+  block_write(x->src, 1, header);
 
-  free(data);
+  for (i = 0; i < EXTRACT_BUFS; i++)
+    palloc_free_multiple(x->bufs[i].data, EXTRACT_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE);
+  free(x);
   free(header);
 }
 
@@ -1,33 +1,71 @@
 #include "filesys/inode.h"
 #include <list.h>
 #include <debug.h>
+#include <lz4.h>
 #include <round.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
-struct singly_indirect_inode_disk {
-  block_sector_t inode_sector[BLOCK_SECTOR_SIZE / sizeof(block_sector_t)];
-};
-
-struct doubly_indirect_inode_disk {
-  block_sector_t singly_indirect_inode_sector[BLOCK_SECTOR_SIZE / sizeof(block_sector_t)];
+/* Number of sector pointers in an indirect block. */
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof(block_sector_t))
+
+/* Sector number that is never a valid indirect block. */
+#define NO_SECTOR ((block_sector_t)-1)
+
+/* Set in a block map pointer to a data sector that was allocated
+   by inode_preallocate() but never written.  Such a sector reads
+   as zeros without being read from disk, and is zeroed in the
+   cache on its first write. */
+#define UNWRITTEN ((block_sector_t)1 << 31)
+
+/* Set in every block map pointer of a compressed cluster, see
+   below.  On its own, with no sector number, marks a data sector
+   of a compressed file that has no disk sector behind it. */
+#define COMPRESSED ((block_sector_t)1 << 30)
+
+/* A compressed file's data is stored a cluster of CLUSTER_SECTORS
+   consecutive data sectors at a time.  A cluster whose data
+   compresses to fewer sectors is stored as a 16-bit length and an
+   LZ4 block in the disk sectors named by its first block map
+   pointers, all marked COMPRESSED, with bare COMPRESSED pointers
+   for the rest.  Any other cluster is stored raw, one data sector
+   per pointer, with bare COMPRESSED pointers for sectors that hold
+   only zeros. */
+#define CLUSTER_SECTORS 8
+#define CLUSTER_SIZE (CLUSTER_SECTORS * BLOCK_SECTOR_SIZE)
+
+/* A cluster of a compressed file being read or written, kept with
+   the open inode so that reading a cluster sequentially
+   decompresses it only once. */
+struct cluster_buf {
+  size_t index;                   /* Cluster held, or CLUSTER_NONE. */
+  uint8_t data[CLUSTER_SIZE];     /* Its data, decompressed. */
+  uint8_t disk[CLUSTER_SIZE];     /* Its compressed form. */
+  uint16_t table[LZ4_TABLE_SIZE]; /* Scratch space for lz4_compress(). */
 };
+#define CLUSTER_NONE SIZE_MAX
 
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly INODE_DISK_SIZE bytes long. */
 struct inode_disk {
   block_sector_t direct; /* First data sector. */
   off_t length;          /* File size in bytes. */
   block_sector_t single_indirect;
   block_sector_t double_indirect;
   uint32_t is_dir;
-  unsigned magic;       /* Magic number. */
-  uint32_t unused[122]; /* Not used. */
+  unsigned magic;           /* Magic number. */
+  block_sector_t dir_index; /* Directory's hashed index inode, or 0. */
+  uint32_t unwritten_cnt;   /* Data sectors marked UNWRITTEN. */
+  uint32_t cloned;          /* May share data sectors with a clone? */
+  uint32_t compressed;      /* Data stored in compressed clusters? */
+  uint32_t unused[22];      /* Not used. */
 };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -37,153 +75,597 @@ static inline size_t bytes_to_sectors(off_t size) { return DIV_ROUND_UP(size, BL
 /* In-memory inode. */
 struct inode {
   struct list_elem elem; /* Element in inode list. */
-  block_sector_t sector; /* Sector number of disk location of the inode. */
+  block_sector_t sector; /* Inode number, which locates it on disk. */
   int open_cnt;          /* Number of openers. */
   bool removed;          /* True if deleted, false otherwise. */
   int deny_write_cnt;    /* 0: writes ok, >0: deny writes. */
 
-  block_sector_t direct; /* First data sector. */
+  /* Protects length and the block map.  Held shared for reads and
+     in-place writes, exclusively while the file is extended. */
+  struct rw_lock meta_lock;
+
+  /* Byte ranges currently being read or written. */
+  struct lock range_lock;          /* Protects ranges. */
+  struct condition range_released; /* Signaled when a range is dropped. */
+  struct list ranges;              /* List of struct inode_range. */
+
+  /* Authoritative copy of the on-disk inode.  Growing the file
+     only changes this copy; it is written back to SECTOR by
+     inode_flush(), on last close or at sync time. */
+  struct inode_disk data;
+  bool dirty; /* True if DATA is newer than the disk copy. */
+
+  /* True if the file's data is file system metadata that goes
+     through the journal, besides that of directories and of the
+     free map file, which always does. */
+  bool journaled;
+
+  /* Free entry slot bookkeeping, for directories only.  Kept in
+     memory and maintained by directory.c. */
+  struct dir_slots slots;
+
+  /* Last cluster used, for compressed files only, or null. */
+  struct lock cluster_lock;    /* Protects CLUSTER. */
+  struct cluster_buf* cluster; /* Allocated on first use. */
+};
 
-  block_sector_t single_indirect;
-  block_sector_t double_indirect;
+/* A byte range [START, END) of an inode's data held by a reader
+   or a writer.  Overlapping ranges conflict unless both are
+   shared.  Lives on the holder's stack for the duration of the
+   access. */
+struct inode_range {
+  struct list_elem elem; /* Element in inode's ranges list. */
+  off_t start;           /* First byte covered. */
+  off_t end;             /* One past the last byte covered. */
+  bool exclusive;        /* Held by a writer? */
+};
 
-  uint32_t is_dir;
+/* Returns true if a range [START, END) held in the given mode
+   would conflict with a range already held on INODE.
+   INODE's range_lock must be held. */
+static bool range_conflicts(struct inode* inode, off_t start, off_t end, bool exclusive) {
+  struct list_elem* e;
 
-  off_t length; /* File size in bytes. */
-};
+  for (e = list_begin(&inode->ranges); e != list_end(&inode->ranges); e = list_next(e)) {
+    struct inode_range* r = list_entry(e, struct inode_range, elem);
+    if (r->start < end && start < r->end && (exclusive || r->exclusive))
+      return true;
+  }
+  return false;
+}
+
+/* Waits until bytes [START, END) of INODE can be held in the
+   given mode, then records them in RANGE. */
+static void inode_range_lock(struct inode* inode, struct inode_range* range, off_t start,
+                             off_t end, bool exclusive) {
+  range->start = start;
+  range->end = end;
+  range->exclusive = exclusive;
+
+  lock_acquire(&inode->range_lock);
+  while (range_conflicts(inode, start, end, exclusive))
+    cond_wait(&inode->range_released, &inode->range_lock);
+  list_push_back(&inode->ranges, &range->elem);
+  lock_release(&inode->range_lock);
+}
+
+/* Drops RANGE from INODE and wakes up anyone waiting on it. */
+static void inode_range_unlock(struct inode* inode, struct inode_range* range) {
+  lock_acquire(&inode->range_lock);
+  list_remove(&range->elem);
+  cond_broadcast(&inode->range_released, &inode->range_lock);
+  lock_release(&inode->range_lock);
+}
+
+/* Reads on-disk inode INUMBER into D. */
+static void read_disk_inode(block_sector_t inumber, struct inode_disk* d) {
+  size_t ofs;
+  block_sector_t sector = free_map_inode_sector(inumber, &ofs);
+  block_read_offsz(fs_device, sector, d, ofs, sizeof *d);
+}
+
+/* Writes D to disk as inode INUMBER.  It shares its sector with
+   other inodes, so it goes through the journal like the rest of
+   the file system's metadata. */
+static void write_disk_inode(block_sector_t inumber, const struct inode_disk* d) {
+  size_t ofs;
+  block_sector_t sector = free_map_inode_sector(inumber, &ofs);
+  block_write_meta(fs_device, sector, d, ofs, sizeof *d);
+}
+
+/* Returns where the data of inode INUMBER should go if it has
+   none yet: just past the sector that holds the inode. */
+static block_sector_t data_goal(block_sector_t inumber) {
+  size_t ofs;
+  return free_map_inode_sector(inumber, &ofs) + 1;
+}
+
+/* Returns the INDEX'th sector pointer in indirect block SECTOR. */
+static block_sector_t read_ptr(block_sector_t sector, size_t index) {
+  block_sector_t ptr;
+  block_read_offsz(fs_device, sector, &ptr, index * sizeof ptr, sizeof ptr);
+  return ptr;
+}
+
+/* Returns the block map pointer to the sector that contains byte
+   offset POS within INODE, which may have UNWRITTEN set.
+   Returns -1 if INODE does not contain data for a byte at offset
+   POS. */
+static block_sector_t map_entry(const struct inode* inode, off_t pos) {
+  const struct inode_disk* d = &inode->data;
+  size_t index;
+
+  ASSERT(inode != NULL);
+  if (pos >= d->length)
+    return -1;
+
+  index = pos / BLOCK_SECTOR_SIZE;
+  if (index == 0)
+    return d->direct;
+  index -= 1;
+  if (index < PTRS_PER_SECTOR)
+    return read_ptr(d->single_indirect, index);
+  index -= PTRS_PER_SECTOR;
+  return read_ptr(read_ptr(d->double_indirect, index / PTRS_PER_SECTOR),
+                  index % PTRS_PER_SECTOR);
+}
 
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
-  ASSERT(inode != NULL);
-  // TODO: EXTEND
-  sizeof(struct inode_disk);
-  if (pos < inode->length) {
-    if (pos < BLOCK_SECTOR_SIZE)
-      return inode->direct + pos / BLOCK_SECTOR_SIZE;
-    pos -= BLOCK_SECTOR_SIZE;
-    uint8_t* temp = malloc(BLOCK_SECTOR_SIZE);
-    // //printf("sepc: %d %d\n", inode->single_indirect, inode);
-
-    if (pos < BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE / 4) {
-      int index = pos / BLOCK_SECTOR_SIZE;
-      block_read(fs_device, inode->single_indirect, temp);
-      block_sector_t ret = ((struct singly_indirect_inode_disk*)temp)->inode_sector[index];
-      // for(int i = 0;i<80;i++)
-      //   //printf("t %d %d\n", i, ((struct singly_indirect_inode_disk*)temp)->inode_sector[i]);
-      free(temp);
-      // //printf("%d from %d\n", pos, ret);
-      return ret;
+  block_sector_t entry = map_entry(inode, pos);
+  return entry == (block_sector_t)-1 ? entry : entry & ~(UNWRITTEN | COMPRESSED);
+}
+
+/* Returns the indirect block that holds INODE's block map pointer
+   to the sector containing byte offset POS, which must be within
+   INODE, and stores the pointer's index in it into *INDEXP.
+   Returns 0 for the first sector, whose pointer is in the inode. */
+static block_sector_t entry_block(const struct inode* inode, off_t pos, size_t* indexp) {
+  const struct inode_disk* d = &inode->data;
+  size_t index = pos / BLOCK_SECTOR_SIZE;
+
+  if (index == 0)
+    return 0;
+  index -= 1;
+  if (index < PTRS_PER_SECTOR) {
+    *indexp = index;
+    return d->single_indirect;
+  }
+  index -= PTRS_PER_SECTOR;
+  *indexp = index % PTRS_PER_SECTOR;
+  return read_ptr(d->double_indirect, index / PTRS_PER_SECTOR);
+}
+
+/* Replaces INODE's block map pointer to the sector that holds
+   byte offset POS, which must be within INODE, by PTR.
+   INODE's meta_lock must be held for writing. */
+static void set_entry(struct inode* inode, off_t pos, block_sector_t ptr) {
+  size_t index;
+  block_sector_t block = entry_block(inode, pos, &index);
+
+  if (block == 0)
+    inode->data.direct = ptr;
+  else
+    block_write_meta(fs_device, block, &ptr, index * sizeof ptr, sizeof ptr);
+  inode->dirty = true;
+}
+
+/* Clears UNWRITTEN in INODE's block map pointer to the sector that
+   holds byte offset POS, once that sector has been written.
+   INODE's meta_lock must be held for writing. */
+static void mark_written(struct inode* inode, off_t pos) {
+  set_entry(inode, pos, map_entry(inode, pos) & ~UNWRITTEN);
+  inode->data.unwritten_cnt--;
+}
+
+/* Most pointers that mark_run_written() updates at once. */
+#define MARK_RUN_MAX 64
+
+/* Like mark_written(), but for the CNT sectors starting at byte
+   offset POS, all of them UNWRITTEN, with one metadata write for
+   each indirect block that holds their pointers.
+   INODE's meta_lock must be held for writing. */
+static void mark_run_written(struct inode* inode, off_t pos, size_t cnt) {
+  block_sector_t ptrs[MARK_RUN_MAX];
+
+  while (cnt > 0) {
+    size_t index, n, i;
+    block_sector_t block = entry_block(inode, pos, &index);
+
+    if (block == 0) {
+      mark_written(inode, pos);
+      pos += BLOCK_SECTOR_SIZE;
+      cnt--;
+      continue;
     }
-    pos -= BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE / 4;
-
-    int index = pos / (BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE / 4);
-    block_read(fs_device, inode->double_indirect, temp);
-    block_sector_t singly_indirect_sector =
-        ((struct doubly_indirect_inode_disk*)temp)->singly_indirect_inode_sector[index];
-    pos -= index * (BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE / 4);
-    index = pos / BLOCK_SECTOR_SIZE;
-    block_read(fs_device, singly_indirect_sector, temp);
-    block_sector_t ret = ((struct singly_indirect_inode_disk*)temp)->inode_sector[index];
-    free(temp);
-    return ret;
-  } else
+    n = PTRS_PER_SECTOR - index;
+    if (n > cnt)
+      n = cnt;
+    if (n > MARK_RUN_MAX)
+      n = MARK_RUN_MAX;
+    block_read_offsz(fs_device, block, ptrs, index * sizeof *ptrs, n * sizeof *ptrs);
+    for (i = 0; i < n; i++)
+      ptrs[i] &= ~UNWRITTEN;
+    block_write_meta(fs_device, block, ptrs, index * sizeof *ptrs, n * sizeof *ptrs);
+    inode->data.unwritten_cnt -= n;
+    inode->dirty = true;
+    pos += n * BLOCK_SECTOR_SIZE;
+    cnt -= n;
+  }
+}
+
+/* Gives INODE a data sector of its own for byte offset POS before
+   it is written, if the one there now is shared with a clone: a
+   new sector takes its place in INODE's block map, holding a copy
+   of its data if COPY is true, and INODE's reference to the old
+   one is dropped.  An UNWRITTEN sector stays UNWRITTEN and is not
+   copied.  Returns the block map pointer to write through, or -1
+   if the disk is full or memory is short.
+   INODE's meta_lock must be held for writing. */
+static block_sector_t unshare(struct inode* inode, off_t pos, bool copy) {
+  block_sector_t entry = map_entry(inode, pos);
+  block_sector_t old = entry & ~UNWRITTEN;
+  block_sector_t sector;
+
+  if (!free_map_is_shared(old))
+    return entry;
+  if (!free_map_allocate_near(1, old + 1, &sector))
     return -1;
+
+  if (copy && !(entry & UNWRITTEN)) {
+    uint8_t* bounce = malloc(BLOCK_SECTOR_SIZE);
+    if (bounce == NULL) {
+      free_map_release(sector, 1);
+      return -1;
+    }
+    block_read(fs_device, old, bounce);
+    block_write(fs_device, sector, bounce);
+    free(bounce);
+  }
+
+  entry = sector | (entry & UNWRITTEN);
+  set_entry(inode, pos, entry);
+  free_map_release(old, 1);
+  return entry;
 }
 
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
 
-/* Initializes the inode module. */
-void inode_init(void) { list_init(&open_inodes); }
+/* Protects open_inodes and the open_cnt of every inode on it. */
+static struct lock open_inodes_lock;
 
-// block_sector_t find_inode_sector(inode* )
+/* Removed inodes whose blocks are waiting to be freed by the
+   reclaim thread, linked through their `elem'. */
+static struct list reclaim_queue;
+static struct lock reclaim_lock;         /* Protects the reclaim state. */
+static struct condition reclaim_pending; /* Signaled when work is queued. */
+static struct condition reclaim_done;    /* Signaled when the queue drains. */
+static bool reclaim_busy;                /* Reclaim thread is freeing blocks? */
 
-void direct_inode(off_t* sz_done, block_sector_t* res, off_t sz_demand, off_t sz_prev_alloc) {
-  // //printf("prev: %d\n", sz_prev_alloc);
+static thread_func reclaim_thread NO_RETURN;
 
-  if (sz_prev_alloc <= *sz_done) {
-    static char zeros[BLOCK_SECTOR_SIZE];
-    free_map_allocate(1, res);
+/* Initializes the inode module. */
+void inode_init(void) {
+  list_init(&open_inodes);
+  lock_init(&open_inodes_lock);
+
+  list_init(&reclaim_queue);
+  lock_init(&reclaim_lock);
+  cond_init(&reclaim_pending);
+  cond_init(&reclaim_done);
+  reclaim_busy = false;
+  thread_create("reclaim", PRI_DEFAULT, reclaim_thread, NULL);
+}
+
+/* Number of sectors handed back to the free map at a time. */
+#define RECLAIM_BATCH 64
+
+/* Sectors being collected for release by inode_free_blocks(). */
+struct reclaim_batch {
+  size_t cnt;                            /* Number of sectors collected. */
+  block_sector_t sectors[RECLAIM_BATCH]; /* Sectors to release. */
+  block_sector_t ptrs[PTRS_PER_SECTOR];  /* Indirect block being walked. */
+  block_sector_t leaf[PTRS_PER_SECTOR];  /* Indirect block under PTRS. */
+};
 
-    block_write(fs_device, *res, zeros);
+/* Adds SECTOR, a block map pointer, to B, releasing the batch if
+   it is full.  A pointer to no sector at all is ignored. */
+static void batch_add(struct reclaim_batch* b, block_sector_t sector) {
+  if (sector == COMPRESSED)
+    return;
+  if (b->cnt == RECLAIM_BATCH) {
+    free_map_release_batch(b->sectors, b->cnt);
+    b->cnt = 0;
   }
-  *sz_done += BLOCK_SECTOR_SIZE;
+  b->sectors[b->cnt++] = sector & ~(UNWRITTEN | COMPRESSED);
 }
 
-void single_indirect_inode(off_t* sz_done, block_sector_t* res, off_t sz_demand,
-                           off_t sz_prev_alloc, uint8_t alloc) {
+/* Releases every sector reachable from D: data sectors and the
+   single and double indirect blocks that map them, and a
+   directory's index inode with its blocks.  Also releases inode
+   number SECTOR unless it is NO_SECTOR. */
+static void inode_free_blocks(block_sector_t sector, const struct inode_disk* d) {
+  size_t left = bytes_to_sectors(d->length);
+  size_t outer, i, n;
+  struct reclaim_batch* b = malloc(sizeof *b);
+
+  if (b == NULL)
+    PANIC("out of memory freeing inode %" PRDSNu, sector);
+  b->cnt = 0;
+
+  if (d->is_dir && d->dir_index != 0) {
+    struct inode_disk* index = malloc(sizeof *index);
+    if (index == NULL)
+      PANIC("out of memory freeing inode %" PRDSNu, sector);
+    read_disk_inode(d->dir_index, index);
+    inode_free_blocks(d->dir_index, index);
+    free(index);
+  }
 
-  if (sz_demand <= BLOCK_SECTOR_SIZE || *sz_done >= sz_demand)
-    return;
+  if (sector != NO_SECTOR)
+    free_map_release_inode(sector);
 
-  struct singly_indirect_inode_disk* disk_inode;
-  disk_inode = malloc(sizeof *disk_inode);
+  if (left > 0) {
+    batch_add(b, d->direct);
+    left--;
+  }
 
-  if (alloc)
-    free_map_allocate(1, res);
-  else
-    block_read(fs_device, *res, disk_inode);
+  if (left > 0) {
+    n = left < PTRS_PER_SECTOR ? left : PTRS_PER_SECTOR;
+    block_read(fs_device, d->single_indirect, b->ptrs);
+    for (i = 0; i < n; i++)
+      batch_add(b, b->ptrs[i]);
+    batch_add(b, d->single_indirect);
+    left -= n;
+  }
+
+  if (left > 0) {
+    block_read(fs_device, d->double_indirect, b->ptrs);
+    for (outer = 0; left > 0; outer++) {
+      n = left < PTRS_PER_SECTOR ? left : PTRS_PER_SECTOR;
+      block_read(fs_device, b->ptrs[outer], b->leaf);
+      for (i = 0; i < n; i++)
+        batch_add(b, b->leaf[i]);
+      batch_add(b, b->ptrs[outer]);
+      left -= n;
+    }
+    batch_add(b, d->double_indirect);
+  } else if (d->double_indirect != 0) {
+    /* Allocated by an extension that then ran out of space for
+       the first block under it, so it maps nothing. */
+    batch_add(b, d->double_indirect);
+  }
+
+  free_map_release_batch(b->sectors, b->cnt);
+  free(b);
+}
+
+/* Frees the blocks of removed inodes in the background, so that
+   the last close of a large file does not wait for it. */
+static void reclaim_thread(void* aux UNUSED) {
+  lock_acquire(&reclaim_lock);
+  for (;;) {
+    struct inode* inode;
 
-  int i = 0;
+    while (list_empty(&reclaim_queue))
+      cond_wait(&reclaim_pending, &reclaim_lock);
+    inode = list_entry(list_pop_front(&reclaim_queue), struct inode, elem);
+    reclaim_busy = true;
+    lock_release(&reclaim_lock);
 
-  for (; i < BLOCK_SECTOR_SIZE / sizeof(block_sector_t) && *sz_done < sz_demand; i++) {
-    direct_inode(sz_done, &disk_inode->inode_sector[i], sz_demand, sz_prev_alloc);
+    inode_free_blocks(inode->sector, &inode->data);
+    free(inode);
+
+    lock_acquire(&reclaim_lock);
+    reclaim_busy = false;
+    if (list_empty(&reclaim_queue))
+      cond_broadcast(&reclaim_done, &reclaim_lock);
   }
+}
 
-  block_write(fs_device, *res, disk_inode);
-  free(disk_inode);
+/* Queues removed, closed INODE to have its blocks freed. */
+static void reclaim_inode(struct inode* inode) {
+  lock_acquire(&reclaim_lock);
+  list_push_back(&reclaim_queue, &inode->elem);
+  cond_signal(&reclaim_pending, &reclaim_lock);
+  lock_release(&reclaim_lock);
 }
 
-void double_indirect_inode(off_t* sz_done, block_sector_t* res, off_t sz_demand,
-                           off_t sz_prev_alloc) {
-  if (sz_demand <= BLOCK_SECTOR_SIZE * (BLOCK_SECTOR_SIZE / 4 + 1) || *sz_done >= sz_demand)
-    return;
+/* Waits until the blocks of every removed inode closed so far
+   have been returned to the free map. */
+void inode_reclaim_wait(void) {
+  lock_acquire(&reclaim_lock);
+  while (!list_empty(&reclaim_queue) || reclaim_busy)
+    cond_wait(&reclaim_done, &reclaim_lock);
+  lock_release(&reclaim_lock);
+}
+
+/* An indirect block being updated by inode_extend(). */
+struct map_block {
+  block_sector_t sector;                /* Block held, or NO_SECTOR. */
+  bool dirty;                           /* Must be written back? */
+  block_sector_t ptrs[PTRS_PER_SECTOR]; /* Sector pointers. */
+};
 
-  struct doubly_indirect_inode_disk* disk_inode;
-  disk_inode = malloc(sizeof *disk_inode);
+/* The indirect blocks an extension is working on, so that each
+   one is read and written at most once per extension no matter
+   how many of its pointers change. */
+struct map_cursor {
+  struct map_block single; /* Single indirect block. */
+  struct map_block dbl;    /* Double indirect block. */
+  struct map_block leaf;   /* Indirect block under DBL. */
+  block_sector_t goal;     /* Where to look for the next free sector. */
+  struct prealloc_window* window; /* Writer's reservation, or null. */
+  bool meta;               /* Are the new data sectors metadata? */
+  bool unwritten;          /* Leave new data sectors UNWRITTEN? */
+  bool hole;               /* Give new data sectors no disk sector? */
+};
 
-  if (sz_prev_alloc <= BLOCK_SECTOR_SIZE * (BLOCK_SECTOR_SIZE / 4 + 1))
-    free_map_allocate(1, res);
+/* Allocates one sector for the extension C describes, from C's
+   preallocation window if it has one, otherwise as close to C's
+   goal as possible, and moves the goal just past it so that
+   consecutive sectors of a file tend to be adjacent on disk. */
+static bool allocate_near(struct map_cursor* c, block_sector_t* sectorp) {
+  if (c->window != NULL ? !free_map_window_take(c->window, c->goal, sectorp)
+                        : !free_map_allocate_near(1, c->goal, sectorp))
+    return false;
+  c->goal = *sectorp + 1;
+  return true;
+}
+
+/* Writes MB back to disk if it was changed. */
+static void map_block_store(struct map_block* mb) {
+  if (mb->sector != NO_SECTOR && mb->dirty)
+    block_write_meta(fs_device, mb->sector, mb->ptrs, 0, BLOCK_SECTOR_SIZE);
+  mb->dirty = false;
+}
+
+/* Makes MB hold indirect block SECTOR, storing whatever it held
+   before.  A FRESH block starts out zeroed instead of being
+   read. */
+static void map_block_load(struct map_block* mb, block_sector_t sector, bool fresh) {
+  if (mb->sector == sector)
+    return;
+  map_block_store(mb);
+  mb->sector = sector;
+  mb->dirty = fresh;
+  if (fresh)
+    memset(mb->ptrs, 0, sizeof mb->ptrs);
   else
-    block_read(fs_device, *res, disk_inode);
+    block_read(fs_device, sector, mb->ptrs);
+}
 
-  int i = 0;
+/* Sets the block map pointer for sector INDEX of D, just past its
+   last one, to PTR, allocating any indirect block needed to reach
+   it.  Indirect blocks are updated through C.  Returns true if
+   successful, false if the disk is full. */
+static bool map_append(struct inode_disk* d, size_t index, block_sector_t ptr,
+                       struct map_cursor* c) {
+  size_t outer, inner;
+
+  if (index == 0) {
+    d->direct = ptr;
+    return true;
+  }
+  index -= 1;
+
+  if (index < PTRS_PER_SECTOR) {
+    if (index == 0 && !allocate_near(c, &d->single_indirect))
+      return false;
+    map_block_load(&c->single, d->single_indirect, index == 0);
+    c->single.ptrs[index] = ptr;
+    c->single.dirty = true;
+    return true;
+  }
+  index -= PTRS_PER_SECTOR;
+
+  outer = index / PTRS_PER_SECTOR;
+  inner = index % PTRS_PER_SECTOR;
+  if (index == 0 && !allocate_near(c, &d->double_indirect))
+    return false;
+  map_block_load(&c->dbl, d->double_indirect, index == 0);
+  if (inner == 0) {
+    if (!allocate_near(c, &c->dbl.ptrs[outer]))
+      return false;
+    c->dbl.dirty = true;
+  }
+  map_block_load(&c->leaf, c->dbl.ptrs[outer], inner == 0);
+  c->leaf.ptrs[inner] = ptr;
+  c->leaf.dirty = true;
+  return true;
+}
 
-  for (; i < BLOCK_SECTOR_SIZE / sizeof(block_sector_t) && *sz_done < sz_demand; i++) {
-    //printf("%d %d\n", sz_prev_alloc , BLOCK_SECTOR_SIZE + BLOCK_SECTOR_SIZE*BLOCK_SECTOR_SIZE/4*(i+1) + 1);
-    single_indirect_inode(
-        sz_done, &disk_inode->singly_indirect_inode_sector[i], sz_demand, sz_prev_alloc,
-        sz_prev_alloc <
-            BLOCK_SECTOR_SIZE + BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE / 4 * (i + 1) + 1);
+/* Allocates a zeroed data sector for sector INDEX of D, along with
+   any indirect block needed to reach it, or one marked UNWRITTEN
+   instead of zeroed if C says so, or none at all for a compressed
+   file.  Indirect blocks are updated through C.  Returns true if
+   successful, false if the disk is full or INDEX is past the
+   largest possible file. */
+static bool extend_one(struct inode_disk* d, size_t index, struct map_cursor* c) {
+  static char zeros[BLOCK_SECTOR_SIZE];
+  block_sector_t sector, ptr;
+
+  if (index >= 1 + PTRS_PER_SECTOR + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    return false;
+  if (c->hole)
+    return map_append(d, index, COMPRESSED, c);
+  if (!allocate_near(c, &sector))
+    return false;
+  if (c->unwritten)
+    ptr = sector | UNWRITTEN;
+  else {
+    ptr = sector;
+    if (c->meta)
+      block_write_meta(fs_device, sector, zeros, 0, BLOCK_SECTOR_SIZE);
+    else
+      block_write(fs_device, sector, zeros);
   }
 
-  block_write(fs_device, *res, disk_inode);
-  free(disk_inode);
+  if (!map_append(d, index, ptr, c)) {
+    free_map_release(sector, 1);
+    return false;
+  }
+  if (c->unwritten)
+    d->unwritten_cnt++;
+  return true;
 }
 
-void inode_extend(block_sector_t sector, off_t sz) {
-  struct inode_disk* disk_inode = NULL;
-  disk_inode = calloc(1, sizeof *disk_inode);
-  block_read(fs_device, sector, disk_inode);
-  if (disk_inode->length < sz) {
-    off_t done = 0;
-    direct_inode(&done, &disk_inode->direct, sz, disk_inode->length);
-    single_indirect_inode(&done, &disk_inode->single_indirect, sz, disk_inode->length,
-                          disk_inode->length <= BLOCK_SECTOR_SIZE);
-    double_indirect_inode(&done, &disk_inode->double_indirect, sz, disk_inode->length);
-    disk_inode->length = sz;
-    block_write(fs_device, sector, disk_inode);
-  }
-  free(disk_inode);
-}
-
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+/* Grows D to LENGTH bytes, allocating zeroed sectors for the new
+   part as close after sector GOAL as possible, or from WINDOW if
+   it is nonnull.  The new sectors are journaled if META is true,
+   or left UNWRITTEN instead of zeroed if UNWRITTEN is true.
+   Only sectors past the old end are visited.  D itself is only changed in memory;
+   writing it back is up to the caller.
+   Returns false if the disk fills up, in which case D grows only
+   as far as sectors could be allocated. */
+static bool inode_extend(struct inode_disk* d, off_t length, block_sector_t goal,
+                         struct prealloc_window* window, bool meta, bool unwritten) {
+  size_t have = bytes_to_sectors(d->length);
+  size_t need = bytes_to_sectors(length);
+  bool success = true;
+
+  if (length <= d->length)
+    return true;
+
+  if (need > have) {
+    struct map_cursor* c = malloc(sizeof *c);
+    if (c == NULL)
+      return false;
+    c->single.sector = c->dbl.sector = c->leaf.sector = NO_SECTOR;
+    c->goal = goal;
+    c->window = window;
+    c->meta = meta;
+    c->unwritten = unwritten;
+    c->hole = d->compressed;
+
+    for (; have < need; have++)
+      if (!extend_one(d, have, c)) {
+        success = false;
+        break;
+      }
+
+    map_block_store(&c->single);
+    map_block_store(&c->dbl);
+    map_block_store(&c->leaf);
+    free(c);
+  }
+
+  if (success)
+    d->length = length;
+  else if ((off_t)have * BLOCK_SECTOR_SIZE > d->length)
+    d->length = have * BLOCK_SECTOR_SIZE;
+  return success;
+}
+
+/* Initializes an inode with LENGTH bytes of data and writes it
+   as inode number SECTOR, which must have been allocated with
+   free_map_allocate_inode().  The data is placed right after the
+   inode's table sector if possible.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool inode_create(block_sector_t sector, off_t length, bool is_dir) {
@@ -193,53 +675,18 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir) {
   ASSERT(length >= 0);
 
   /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
-  ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+     one inode table slot in size, and you should fix that. */
+  ASSERT(sizeof *disk_inode == INODE_DISK_SIZE);
 
   disk_inode = calloc(1, sizeof *disk_inode);
   if (disk_inode != NULL) {
-    size_t sectors = bytes_to_sectors(length);
-    disk_inode->length = 0;
     disk_inode->magic = INODE_MAGIC;
     disk_inode->is_dir = is_dir;
-    block_write(fs_device, sector, disk_inode);
-    // if (free_map_allocate(1, &disk_inode->direct)) {
-    //   // if (sectors > 0) {
-    //   //   static char zeros[BLOCK_SECTOR_SIZE];
-    //   //   size_t i;
-
-    //   //   // for (i = 0; i < sectors; i++)
-    //   //   block_write(fs_device, disk_inode->direct, zeros);
-
-    //   //   sectors--;
-    //   //   if (sectors > 0) {
-    //   //     free_map_allocate(1, &disk_inode->single_indirect);
-    //   //     int i = 0;
-    //   //     int num_sectors = sectors <= BLOCK_SECTOR_SIZE / sizeof(block_sector_t)
-    //   //                           ? sectors
-    //   //                           : BLOCK_SECTOR_SIZE / sizeof(block_sector_t);
-    //   //     // //printf("sepc: %d %d\n", disk_inode->single_indirect, disk_inode);
-    //   //     for (; i < num_sectors; i++) {
-    //   //       block_sector_t sector_new;
-    //   //       free_map_allocate(1, &sector_new);
-    //   //       block_write_offsz(fs_device, disk_inode->single_indirect, &sector_new,
-    //   //                         sizeof(block_sector_t) * i, sizeof(block_sector_t));
-    //   //       // //printf("%d at %d\n", i, sector_new);
-    //   //     }
-    //   //     sectors -= i;
-
-    //   //     if (sectors > 0) {
-    //   //     }
-    //   //     // //printf("SZ: %d %d\n", length, sectors);
-    //   //     ASSERT(sectors <= 0);
-    //   //   }
-    //   // }
-    //   // block_write(fs_device, sector, disk_inode);
-    //   success = true;
-    // }
-    success = true;
-    inode_extend(sector, length);
-    // //printf("new length: %d\n", length);
+    success = inode_extend(disk_inode, length, data_goal(sector), NULL, is_dir, false);
+    if (success)
+      write_disk_inode(sector, disk_inode);
+    else
+      inode_free_blocks(NO_SECTOR, disk_inode);
     free(disk_inode);
   }
   return success;
@@ -248,14 +695,18 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir) {
 bool inode_already_open(block_sector_t sector) {
   struct list_elem* e;
   struct inode* inode;
+  bool found = false;
 
+  lock_acquire(&open_inodes_lock);
   for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
     inode = list_entry(e, struct inode, elem);
     if (inode->sector == sector) {
-      return true;
+      found = true;
+      break;
     }
   }
-  return false;
+  lock_release(&open_inodes_lock);
+  return found;
 }
 
 /* Reads an inode from SECTOR
@@ -266,68 +717,575 @@ struct inode* inode_open(block_sector_t sector) {
   struct inode* inode;
 
   /* Check whether this inode is already open. */
+  lock_acquire(&open_inodes_lock);
   for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
     inode = list_entry(e, struct inode, elem);
     if (inode->sector == sector) {
-      inode_reopen(inode);
+      inode->open_cnt++;
+      lock_release(&open_inodes_lock);
       return inode;
     }
   }
 
   /* Allocate memory. */
   inode = malloc(sizeof *inode);
-  if (inode == NULL)
+  if (inode == NULL) {
+    lock_release(&open_inodes_lock);
     return NULL;
+  }
 
-  /* Initialize. */
+  /* Initialize.  The inode is read in before open_inodes_lock is
+     dropped so that a concurrent opener never sees it half done. */
   list_push_front(&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  struct inode_disk tempbuffer;
-
-  block_read(fs_device, inode->sector, &tempbuffer);
-
-  inode->is_dir = tempbuffer.is_dir;
-  inode->direct = tempbuffer.direct;
-  inode->length = tempbuffer.length;
-  inode->single_indirect = tempbuffer.single_indirect;
-  inode->double_indirect = tempbuffer.double_indirect;
+  rw_lock_init(&inode->meta_lock);
+  lock_init(&inode->range_lock);
+  cond_init(&inode->range_released);
+  list_init(&inode->ranges);
+  inode->dirty = false;
+  inode->journaled = false;
+  inode->slots.hint = 0;
+  inode->slots.free_cnt = -1;
+  lock_init(&inode->cluster_lock);
+  inode->cluster = NULL;
+  read_disk_inode(inode->sector, &inode->data);
+  lock_release(&open_inodes_lock);
   return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode* inode_reopen(struct inode* inode) {
-  if (inode != NULL)
+  if (inode != NULL) {
+    lock_acquire(&open_inodes_lock);
     inode->open_cnt++;
+    lock_release(&open_inodes_lock);
+  }
   return inode;
 }
 
+/* Writes INODE's metadata back to disk if it has changed since it
+   was last written.  Removed inodes are never written back. */
+void inode_flush(struct inode* inode) {
+  rw_lock_acquire_read(&inode->meta_lock);
+  if (inode->dirty && !inode->removed) {
+    write_disk_inode(inode->sector, &inode->data);
+    inode->dirty = false;
+  }
+  rw_lock_release_read(&inode->meta_lock);
+}
+
+/* Writes back the metadata of every open inode. */
+void inode_flush_all(void) {
+  struct list_elem* e;
+
+  lock_acquire(&open_inodes_lock);
+  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e))
+    inode_flush(list_entry(e, struct inode, elem));
+  lock_release(&open_inodes_lock);
+}
+
+/* Returns true if INODE's data goes through the journal. */
+static bool is_metadata(const struct inode* inode) {
+  return inode->data.is_dir || inode->sector == FREE_MAP_SECTOR || inode->journaled;
+}
+
+/* Makes writes to INODE's data go through the journal from now
+   on, for files that hold file system metadata, such as directory
+   indexes.  Lasts until INODE is last closed. */
+void inode_set_journaled(struct inode* inode) { inode->journaled = true; }
+
 /* Returns INODE's inode number. */
 block_sector_t inode_get_inumber(const struct inode* inode) { return inode->sector; }
 
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If INODE was also a removed inode, hands it to the reclaim
+   thread to free its blocks.
+
+   The last closer writes INODE's metadata back while INODE is
+   still in open_inodes, so that a concurrent inode_open() of the
+   same sector shares it rather than reading a stale copy from
+   disk.  Whoever reopens INODE meanwhile may dirty it again, so
+   the check is repeated until INODE is clean when it is taken off
+   the list. */
 void inode_close(struct inode* inode) {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  for (;;) {
+    lock_acquire(&open_inodes_lock);
+    if (inode->open_cnt > 1 || inode->removed || !inode->dirty) {
+      last = --inode->open_cnt == 0;
+      if (last)
+        list_remove(&inode->elem);
+      lock_release(&open_inodes_lock);
+      break;
+    }
+    lock_release(&open_inodes_lock);
+    inode_flush(inode);
+  }
+
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0) {
-    /* Remove from inode list and release lock. */
-    list_remove(&inode->elem);
+  if (last) {
+    free(inode->cluster);
 
     /* Deallocate blocks if removed. */
-    if (inode->removed) {
-      free_map_release(inode->sector, 1);
-      free_map_release(inode->direct, bytes_to_sectors(inode->length));
+    if (inode->removed)
+      reclaim_inode(inode);
+    else
+      free(inode);
+  }
+}
+
+/* Returns INODE's cluster buffer, allocating it if need be, or a
+   null pointer if memory is short.
+   INODE's cluster_lock must be held. */
+static struct cluster_buf* get_cluster_buf(struct inode* inode) {
+  if (inode->cluster == NULL) {
+    inode->cluster = malloc(sizeof *inode->cluster);
+    if (inode->cluster != NULL)
+      inode->cluster->index = CLUSTER_NONE;
+  }
+  return inode->cluster;
+}
+
+/* Returns the number of data sectors of INODE, which must have
+   at least one, in cluster C. */
+static size_t cluster_sectors(const struct inode* inode, size_t c) {
+  size_t left = bytes_to_sectors(inode->data.length) - c * CLUSTER_SECTORS;
+  return left < CLUSTER_SECTORS ? left : CLUSTER_SECTORS;
+}
+
+/* Returns the block map pointer for sector I of cluster C of
+   INODE. */
+static block_sector_t cluster_entry(const struct inode* inode, size_t c, size_t i) {
+  return map_entry(inode, (c * CLUSTER_SECTORS + i) * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads cluster C of compressed INODE into INODE's cluster buffer,
+   decompressing it if it is stored compressed, unless the buffer
+   holds it already.  Returns the buffer, or a null pointer if
+   memory is short or the cluster is corrupt.
+   INODE's meta_lock and cluster_lock must be held. */
+static struct cluster_buf* load_cluster(struct inode* inode, size_t c) {
+  struct cluster_buf* cb = get_cluster_buf(inode);
+  size_t cnt, i;
+  block_sector_t first;
+
+  if (cb == NULL || cb->index == c)
+    return cb;
+  cb->index = CLUSTER_NONE;
+  cnt = cluster_sectors(inode, c);
+  memset(cb->data, 0, CLUSTER_SIZE);
+
+  first = cluster_entry(inode, c, 0);
+  if (first != COMPRESSED && (first & COMPRESSED)) {
+    uint16_t len;
+
+    for (i = 0; i < cnt && cluster_entry(inode, c, i) != COMPRESSED; i++)
+      block_read(fs_device, cluster_entry(inode, c, i) & ~COMPRESSED,
+                 cb->disk + i * BLOCK_SECTOR_SIZE);
+    memcpy(&len, cb->disk, sizeof len);
+    if (sizeof len + len > i * BLOCK_SECTOR_SIZE ||
+        lz4_decompress(cb->disk + sizeof len, len, cb->data, CLUSTER_SIZE) == LZ4_ERROR)
+      return NULL;
+  } else
+    for (i = 0; i < cnt; i++) {
+      block_sector_t entry = cluster_entry(inode, c, i);
+      if (entry != COMPRESSED)
+        block_read(fs_device, entry, cb->data + i * BLOCK_SECTOR_SIZE);
     }
 
-    free(inode);
+  cb->index = c;
+  return cb;
+}
+
+/* Returns true if the BLOCK_SECTOR_SIZE bytes at P are all
+   zero. */
+static bool is_zero_sector(const uint8_t* p) {
+  size_t i;
+
+  for (i = 0; i < BLOCK_SECTOR_SIZE; i++)
+    if (p[i] != 0)
+      return false;
+  return true;
+}
+
+/* Writes the first VALID bytes of INODE's cluster buffer back as
+   cluster C of compressed INODE, compressed if that takes fewer
+   sectors, raw otherwise.  Data sectors of the cluster past VALID,
+   and raw ones that hold only zeros, get no disk sector.
+   A raw sector that was raw before is overwritten in place, like
+   the data of any other file.  Everything else goes to newly
+   allocated sectors, and the old ones are released only after the
+   block map points at the new ones, so that a crash in between
+   leaves the old cluster readable.  Returns true if successful,
+   false if the disk is full, in which case the cluster is
+   unchanged.
+   INODE's meta_lock must be held for writing and its cluster_lock
+   held, with cluster C in its cluster buffer. */
+static bool store_cluster(struct inode* inode, size_t c, size_t valid) {
+  struct cluster_buf* cb = inode->cluster;
+  size_t cnt = cluster_sectors(inode, c);
+  size_t need = DIV_ROUND_UP(valid, BLOCK_SECTOR_SIZE);
+  block_sector_t old[CLUSTER_SECTORS], new[CLUSTER_SECTORS];
+  block_sector_t flag = 0, goal;
+  const uint8_t* src = cb->data;
+  size_t i;
+
+  ASSERT(cb->index == c);
+  ASSERT(need <= cnt);
+
+  /* Compress into at least one sector fewer, if possible. */
+  if (need > 1) {
+    uint16_t len;
+    size_t clen = lz4_compress(cb->data, valid, cb->disk + sizeof len,
+                               (need - 1) * BLOCK_SECTOR_SIZE - sizeof len, cb->table);
+    if (clen > 0) {
+      len = clen;
+      memcpy(cb->disk, &len, sizeof len);
+      need = DIV_ROUND_UP(sizeof len + clen, BLOCK_SECTOR_SIZE);
+      flag = COMPRESSED;
+      src = cb->disk;
+    }
+  }
+
+  /* Allocate new sectors right after the cluster's last one, or
+     after the previous cluster's. */
+  goal = c > 0 ? (cluster_entry(inode, c - 1, 0) & ~COMPRESSED) + CLUSTER_SECTORS
+               : data_goal(inode->sector);
+  for (i = 0; i < cnt; i++) {
+    old[i] = cluster_entry(inode, c, i);
+    if (old[i] != COMPRESSED)
+      goal = (old[i] & ~COMPRESSED) + 1;
+  }
+  for (i = 0; i < need; i++) {
+    if (flag == 0 && is_zero_sector(src + i * BLOCK_SECTOR_SIZE))
+      new[i] = COMPRESSED;
+    else if (flag == 0 && !(old[i] & COMPRESSED))
+      new[i] = old[i];
+    else if (free_map_allocate_near(1, goal, &new[i]))
+      goal = new[i] + 1;
+    else {
+      while (i-- > 0)
+        if (new[i] != COMPRESSED && new[i] != old[i])
+          free_map_release(new[i], 1);
+      return false;
+    }
+  }
+
+  for (i = 0; i < need; i++)
+    if (new[i] != COMPRESSED)
+      block_write(fs_device, new[i], src + i * BLOCK_SECTOR_SIZE);
+  for (i = 0; i < cnt; i++) {
+    block_sector_t ptr = i < need && new[i] != COMPRESSED ? new[i] | flag : COMPRESSED;
+    if (old[i] != ptr)
+      set_entry(inode, (c * CLUSTER_SECTORS + i) * BLOCK_SECTOR_SIZE, ptr);
+  }
+  for (i = 0; i < cnt; i++)
+    if (old[i] != COMPRESSED && (i >= need || new[i] != old[i]))
+      free_map_release(old[i] & ~COMPRESSED, 1);
+  return true;
+}
+
+/* Reads SIZE bytes at OFFSET of compressed INODE into BUFFER, a
+   cluster at a time.  Returns the number of bytes read.
+   INODE's meta_lock must be held. */
+static off_t compressed_read(struct inode* inode, uint8_t* buffer, off_t size, off_t offset) {
+  off_t done = 0;
+
+  lock_acquire(&inode->cluster_lock);
+  while (size > 0) {
+    int ofs = offset % CLUSTER_SIZE;
+    off_t inode_left = inode_length(inode) - offset;
+    int cluster_left = CLUSTER_SIZE - ofs;
+    off_t chunk = size < inode_left ? size : inode_left;
+    struct cluster_buf* cb;
+
+    if (chunk > cluster_left)
+      chunk = cluster_left;
+    if (chunk <= 0 || (cb = load_cluster(inode, offset / CLUSTER_SIZE)) == NULL)
+      break;
+    memcpy(buffer + done, cb->data + ofs, chunk);
+
+    size -= chunk;
+    offset += chunk;
+    done += chunk;
+  }
+  lock_release(&inode->cluster_lock);
+  return done;
+}
+
+/* Writes SIZE bytes from BUFFER at OFFSET of compressed INODE,
+   which must already be long enough, recompressing each cluster
+   written.  A cluster written whole is not read first.  Returns
+   the number of bytes written.
+   INODE's meta_lock must be held for writing. */
+static off_t compressed_write(struct inode* inode, const uint8_t* buffer, off_t size,
+                              off_t offset) {
+  off_t done = 0;
+
+  lock_acquire(&inode->cluster_lock);
+  while (size > 0) {
+    size_t c = offset / CLUSTER_SIZE;
+    int ofs = offset % CLUSTER_SIZE;
+    off_t cluster_len = inode_length(inode) - (off_t)c * CLUSTER_SIZE;
+    off_t chunk = size < CLUSTER_SIZE - ofs ? size : CLUSTER_SIZE - ofs;
+    struct cluster_buf* cb;
+
+    if (cluster_len > CLUSTER_SIZE)
+      cluster_len = CLUSTER_SIZE;
+    if (chunk > cluster_len - ofs)
+      chunk = cluster_len - ofs;
+    if (chunk <= 0)
+      break;
+    if (ofs == 0 && chunk == cluster_len) {
+      cb = get_cluster_buf(inode);
+      if (cb != NULL) {
+        cb->index = c;
+        memset(cb->data + chunk, 0, CLUSTER_SIZE - chunk);
+      }
+    } else
+      cb = load_cluster(inode, c);
+    if (cb == NULL)
+      break;
+    memcpy(cb->data + ofs, buffer + done, chunk);
+    if (!store_cluster(inode, c, cluster_len)) {
+      cb->index = CLUSTER_NONE;
+      break;
+    }
+
+    size -= chunk;
+    offset += chunk;
+    done += chunk;
+  }
+  lock_release(&inode->cluster_lock);
+  return done;
+}
+
+/* Makes INODE store its data in compressed clusters from now on
+   if COMPRESSED is true, or raw if it is false.  Returns true if
+   successful, false if INODE is file system metadata or a clone,
+   or not empty. */
+bool inode_set_compressed(struct inode* inode, bool compressed) {
+  bool success;
+
+  rw_lock_acquire_write(&inode->meta_lock);
+  success = (bool)inode->data.compressed == compressed ||
+            (inode->data.length == 0 && !is_metadata(inode));
+  if (success && (bool)inode->data.compressed != compressed) {
+    inode->data.compressed = compressed;
+    inode->dirty = true;
+  }
+  rw_lock_release_write(&inode->meta_lock);
+  return success;
+}
+
+/* Returns true if INODE stores its data compressed. */
+bool inode_is_compressed(struct inode* inode) { return inode->data.compressed; }
+
+/* Shrinks INODE to LENGTH bytes if it is longer, adding the data
+   sectors past the new end and any indirect blocks no longer
+   needed to B.  The rest of the new last sector is zeroed, so that
+   growing the file again reads zeros there.
+   INODE's meta_lock must be held for writing. */
+static void truncate_locked(struct inode* inode, off_t length, struct reclaim_batch* b) {
+  static char zeros[BLOCK_SECTOR_SIZE];
+  struct inode_disk* d = &inode->data;
+  size_t have, keep, i, outer;
+
+  if (length >= d->length)
+    return;
+
+  /* In a compressed file, the cluster that will hold the new end
+     is rewritten first, zeroed past it, so that its data no longer
+     reaches into the sectors about to be released. */
+  if (d->compressed) {
+    struct cluster_buf* cb = NULL;
+
+    lock_acquire(&inode->cluster_lock);
+    if (length % CLUSTER_SIZE != 0) {
+      size_t valid = length % CLUSTER_SIZE;
+
+      cb = load_cluster(inode, length / CLUSTER_SIZE);
+      if (cb != NULL)
+        memset(cb->data + valid, 0, CLUSTER_SIZE - valid);
+      if (cb == NULL || !store_cluster(inode, length / CLUSTER_SIZE, valid)) {
+        if (inode->cluster != NULL)
+          inode->cluster->index = CLUSTER_NONE;
+        lock_release(&inode->cluster_lock);
+        return;
+      }
+    }
+    if (inode->cluster != NULL)
+      inode->cluster->index = CLUSTER_NONE;
+    lock_release(&inode->cluster_lock);
+  }
+
+  have = bytes_to_sectors(d->length);
+  keep = bytes_to_sectors(length);
+  for (i = keep; i < have; i++) {
+    block_sector_t entry = map_entry(inode, i * BLOCK_SECTOR_SIZE);
+    if (entry & UNWRITTEN)
+      d->unwritten_cnt--;
+    batch_add(b, entry);
+  }
+
+  /* Indirect blocks that map nothing any more.  Their pointers in
+     D are cleared, so that a nonzero one always names a block that
+     D owns. */
+  if (have > 1 && keep <= 1) {
+    batch_add(b, d->single_indirect);
+    d->single_indirect = 0;
+  }
+  if (have > 1 + PTRS_PER_SECTOR) {
+    size_t groups = DIV_ROUND_UP(have - 1 - PTRS_PER_SECTOR, PTRS_PER_SECTOR);
+    for (outer = 0; outer < groups; outer++)
+      if (keep <= 1 + PTRS_PER_SECTOR + outer * PTRS_PER_SECTOR)
+        batch_add(b, read_ptr(d->double_indirect, outer));
+    if (keep <= 1 + PTRS_PER_SECTOR) {
+      batch_add(b, d->double_indirect);
+      d->double_indirect = 0;
+    }
+  }
+
+  if (length % BLOCK_SECTOR_SIZE != 0 && !d->compressed &&
+      !(map_entry(inode, length - 1) & UNWRITTEN) &&
+      (!d->cloned || unshare(inode, length - 1, true) != (block_sector_t)-1)) {
+    block_sector_t last = byte_to_sector(inode, length - 1);
+    int ofs = length % BLOCK_SECTOR_SIZE;
+
+    if (is_metadata(inode))
+      block_write_meta(fs_device, last, zeros, ofs, BLOCK_SECTOR_SIZE - ofs);
+    else
+      block_write_offsz(fs_device, last, zeros, ofs, BLOCK_SECTOR_SIZE - ofs);
+  }
+  d->length = length;
+  if (length == 0)
+    d->cloned = false;
+  inode->dirty = true;
+}
+
+/* Shrinks INODE to LENGTH bytes if it is longer, releasing the
+   data sectors past the new end and any indirect blocks no longer
+   needed.  The rest of the new last sector is zeroed, so that
+   growing the file again reads zeros there. */
+void inode_truncate(struct inode* inode, off_t length) {
+  struct reclaim_batch* b;
+
+  ASSERT(length >= 0);
+
+  b = malloc(sizeof *b);
+  if (b == NULL)
+    return;
+  b->cnt = 0;
+
+  rw_lock_acquire_write(&inode->meta_lock);
+  truncate_locked(inode, length, b);
+  rw_lock_release_write(&inode->meta_lock);
+
+  free_map_release_batch(b->sectors, b->cnt);
+  free(b);
+}
+
+/* Makes DST a copy-on-write clone of SRC.  DST gets a block map
+   of its own that points at SRC's data sectors, each of which
+   gains a reference in the free map, and only then is DST's old
+   data released.  No data is read or written: a shared sector is
+   copied only when one of the two files next writes it.
+   Returns true if successful, false if DST is SRC, either one is
+   file system metadata, DST denies writes, or the disk is full or
+   the references run out, in which case DST is unchanged. */
+bool inode_clone(struct inode* dst, struct inode* src) {
+  struct inode* first = dst->sector < src->sector ? dst : src;
+  struct inode* second = first == dst ? src : dst;
+  struct reclaim_batch* b;
+  struct map_cursor* c;
+  struct inode_disk* map;
+  size_t cnt, placed;
+
+  if (dst == src || dst->deny_write_cnt || is_metadata(dst) || is_metadata(src) ||
+      dst->data.compressed || src->data.compressed)
+    return false;
+  b = malloc(sizeof *b);
+  c = malloc(sizeof *c);
+  map = calloc(1, sizeof *map);
+  if (b == NULL || c == NULL || map == NULL) {
+    free(b);
+    free(c);
+    free(map);
+    return false;
+  }
+  b->cnt = 0;
+  c->single.sector = c->dbl.sector = c->leaf.sector = NO_SECTOR;
+  c->goal = data_goal(dst->sector);
+  c->window = NULL;
+  c->meta = false;
+  c->unwritten = false;
+  c->hole = false;
+
+  rw_lock_acquire_write(&first->meta_lock);
+  rw_lock_acquire_write(&second->meta_lock);
+
+  /* The new block map is built on the side, in MAP.  Only data
+     sectors are shared; DST's indirect blocks are its own, so
+     either file can change its block map freely. */
+  cnt = bytes_to_sectors(src->data.length);
+  for (placed = 0; placed < cnt; placed++) {
+    block_sector_t entry = map_entry(src, placed * BLOCK_SECTOR_SIZE);
+
+    if (!free_map_share(entry & ~UNWRITTEN))
+      break;
+    if (!map_append(map, placed, entry, c)) {
+      free_map_release(entry & ~UNWRITTEN, 1);
+      break;
+    }
+    if (entry & UNWRITTEN)
+      map->unwritten_cnt++;
+  }
+  map_block_store(&c->single);
+  map_block_store(&c->dbl);
+  map_block_store(&c->leaf);
+
+  if (placed == cnt) {
+    /* Every sector is shared, so DST's old data can go. */
+    truncate_locked(dst, 0, b);
+    dst->data.direct = map->direct;
+    dst->data.single_indirect = map->single_indirect;
+    dst->data.double_indirect = map->double_indirect;
+    dst->data.unwritten_cnt = map->unwritten_cnt;
+    dst->data.length = src->data.length;
+    if (cnt > 0) {
+      dst->data.cloned = src->data.cloned = true;
+      src->dirty = true;
+    }
+    dst->dirty = true;
+  } else {
+    /* Drops the references taken so far and the new map's
+       indirect blocks, leaving DST as it was. */
+    map->length = placed * BLOCK_SECTOR_SIZE;
+    inode_free_blocks(NO_SECTOR, map);
   }
+  rw_lock_release_write(&second->meta_lock);
+  rw_lock_release_write(&first->meta_lock);
+
+  free_map_release_batch(b->sectors, b->cnt);
+  free(b);
+  free(c);
+  free(map);
+  return placed == cnt;
+}
+
+/* Returns directory INODE's free slot bookkeeping. */
+struct dir_slots* inode_dir_slots(struct inode* inode) {
+  ASSERT(inode->data.is_dir);
+  return &inode->slots;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -343,100 +1301,385 @@ void inode_remove(struct inode* inode) {
 off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset) {
   uint8_t* buffer = buffer_;
   off_t bytes_read = 0;
+  struct inode_range range;
 
-  while (size > 0) {
-    /* Disk sector to read, directing byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector(inode, offset);
-    //printf("ra at %d from %d through %d + %d\n", sector_idx, offset, inode->sector, inode->direct);
+  inode_range_lock(inode, &range, offset, offset + size, false);
+  rw_lock_acquire_read(&inode->meta_lock);
 
-    int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+  if (inode->data.compressed)
+    bytes_read = compressed_read(inode, buffer, size, offset);
+  else
+    while (size > 0) {
+      /* Disk sector to read, directing byte offset within sector. */
+      block_sector_t entry = map_entry(inode, offset);
+      block_sector_t sector_idx = entry & ~UNWRITTEN;
+
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      off_t inode_left = inode_length(inode) - offset;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int min_left = inode_left < sector_left ? inode_left : sector_left;
+
+      /* Number of bytes to actually copy out of this sector. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      if (entry & UNWRITTEN) {
+        /* Preallocated but never written: zeros, without disk I/O. */
+        memset(buffer + bytes_read, 0, chunk_size);
+      } else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
+        /* Read full sector directly into caller's buffer. */
+        block_read(fs_device, sector_idx, buffer + bytes_read);
+      } else {
+        /* Read sector into bounce buffer, then partially copy
+               into caller's buffer. */
+        block_read_offsz(fs_device, sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      }
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
 
-    /* Bytes left in inode, bytes left in sector, lesser of the two. */
-    off_t inode_left = inode_length(inode) - offset;
-    int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-    int min_left = inode_left < sector_left ? inode_left : sector_left;
+  rw_lock_release_read(&inode->meta_lock);
+  inode_range_unlock(inode, &range);
+  return bytes_read;
+}
 
-    /* Number of bytes to actually copy out of this sector. */
-    int chunk_size = size < min_left ? size : min_left;
-    if (chunk_size <= 0)
-      break;
+/* Returns where new sectors of INODE should go: just past its
+   last data sector, or past the inode itself if it has none.
+   INODE's meta_lock must be held. */
+static block_sector_t extend_goal(const struct inode* inode) {
+  if (inode->data.length > 0)
+    return byte_to_sector(inode, inode->data.length - 1) + 1;
+  return data_goal(inode->sector);
+}
 
-    if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-      /* Read full sector directly into caller's buffer. */
-      block_read(fs_device, sector_idx, buffer + bytes_read);
-    } else {
-      /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-      block_read_offsz(fs_device, sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
-    }
-    /* Advance. */
-    size -= chunk_size;
-    offset += chunk_size;
-    bytes_read += chunk_size;
+/* Grows INODE to LEN bytes if it is shorter, continuing from its
+   last data sector, or from the inode itself if it has none, or
+   taking sectors from WINDOW if it is nonnull.
+   INODE's meta_lock must be held for writing. */
+static void inode_update(struct inode* inode, off_t len, struct prealloc_window* window) {
+  if (len <= inode->data.length)
+    return;
+  inode_extend(&inode->data, len, extend_goal(inode), window, is_metadata(inode), false);
+  inode->dirty = true;
+}
+
+/* Returns the number of sectors, data and indirect, that an inode
+   LENGTH bytes long uses. */
+static size_t total_sectors(off_t length) {
+  size_t data = bytes_to_sectors(length);
+  size_t total = data;
+
+  if (data > 1)
+    total++;
+  if (data > 1 + PTRS_PER_SECTOR)
+    total += 1 + DIV_ROUND_UP(data - 1 - PTRS_PER_SECTOR, PTRS_PER_SECTOR);
+  return total;
+}
+
+/* Grows INODE to LENGTH bytes if it is shorter, allocating all of
+   the new sectors up front as a single run right after its last
+   data sector if one is free, so that a file whose final size is
+   known is laid out contiguously.  The new data sectors are marked
+   UNWRITTEN rather than zeroed: the new part reads as zeros, and
+   nothing is written until the file's own data is.
+   Returns true if INODE is now at least LENGTH bytes long. */
+bool inode_preallocate(struct inode* inode, off_t length) {
+  struct prealloc_window w;
+  size_t need;
+  bool success;
+
+  if (inode->deny_write_cnt || inode->data.compressed)
+    return false;
+
+  rw_lock_acquire_write(&inode->meta_lock);
+  free_map_window_init(&w);
+  need = total_sectors(length) - total_sectors(inode->data.length);
+  if (need > 0 && free_map_allocate_near(need, extend_goal(inode), &w.next))
+    w.cnt = need;
+  if (length > inode->data.length && !is_metadata(inode)) {
+    inode_extend(&inode->data, length, extend_goal(inode), &w, false, true);
+    inode->dirty = true;
   }
+  success = inode->data.length >= length;
+  rw_lock_release_write(&inode->meta_lock);
 
-  return bytes_read;
+  free_map_window_release(&w);
+  return success;
 }
 
-void inode_update(struct inode* inode, off_t len) {
-  if (len <= inode->length)
+/* Reserves in WINDOW, which belongs to an open file of INODE, the
+   sectors that growing INODE to LENGTH bytes would take, as one
+   run right after its last data sector if one is free.  Unlike
+   inode_preallocate(), INODE's length is left alone: writes
+   through WINDOW extend INODE into the run only as their data
+   lands, so a write that falls short leaves nothing to take back.
+   Sectors not used stay reserved until WINDOW is released. */
+void inode_reserve(struct inode* inode, off_t length, struct prealloc_window* window) {
+  size_t need;
+
+  if (is_metadata(inode) || inode->data.compressed)
     return;
-  //printf("EXTEND FROM %d to %d at %d + %d\n", inode->length, len, inode->sector, inode->direct);
-  struct inode_disk* disk_inode = malloc(sizeof(struct inode_disk));
-  inode_extend(inode->sector, len);
-  block_read(fs_device, inode->sector, disk_inode);
-  inode->single_indirect = disk_inode->single_indirect;
-  inode->double_indirect = disk_inode->double_indirect;
-  inode->direct = disk_inode->direct;
-  inode->length = disk_inode->length;
-  free(disk_inode);
+
+  rw_lock_acquire_read(&inode->meta_lock);
+  if (length > inode->data.length) {
+    need = total_sectors(length) - total_sectors(inode->data.length);
+    free_map_window_release(window);
+    if (free_map_allocate_near(need, extend_goal(inode), &window->next))
+      window->cnt = need;
+  }
+  rw_lock_release_read(&inode->meta_lock);
 }
 
 /* Writes SIZE bytes from BUFFER into INODE, directing at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   A write past end of file extends the inode.  Writes that stay
+   within the file only hold the metadata lock shared, so they run
+   concurrently with readers and with writers of other ranges. */
 off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t offset) {
+  return inode_write_at_window(inode, buffer_, size, offset, NULL);
+}
+
+/* Like inode_write_at(), but sectors needed to extend INODE are
+   taken from WINDOW, which belongs to the open file being written,
+   if WINDOW is nonnull. */
+off_t inode_write_at_window(struct inode* inode, const void* buffer_, off_t size, off_t offset,
+                            struct prealloc_window* window) {
   const uint8_t* buffer = buffer_;
   off_t bytes_written = 0;
-
-  inode_update(inode, size + offset);
+  struct inode_range range;
+  bool meta = is_metadata(inode);
+  bool extending, exclusive;
 
   if (inode->deny_write_cnt)
     return 0;
 
-  while (size > 0) {
-    /* Sector to write, directing byte offset within sector. */
-    block_sector_t sector_idx = byte_to_sector(inode, offset);
-    //printf("a at %d from %d through %d +\n", sector_idx, offset, inode->sector);
-    int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+  inode_range_lock(inode, &range, offset, offset + size, true);
+
+  /* Length changes only under the exclusive lock, but it can
+     shrink as well as grow, as when inode_truncate() compacts a
+     directory.  A truncate that lands between the unlocked check
+     below and taking the lock shared leaves the write short,
+     since each chunk is bounded by the length read under the
+     lock, and a write past the new end of file stops at the first
+     chunk.  The first write to an UNWRITTEN sector changes the
+     block map, so a file with any of those is also written
+     exclusively.  So are a clone, whose shared sectors are
+     replaced on write, and a compressed file, whose clusters move
+     on every write.  A file can become any of these at any time,
+     a truncated one refilled by inode_preallocate() included, so
+     that is checked again under the lock. */
+  extending = offset + size > inode_length(inode);
+  exclusive = extending || inode->data.unwritten_cnt > 0 || inode->data.cloned ||
+              inode->data.compressed;
+  if (exclusive) {
+    rw_lock_acquire_write(&inode->meta_lock);
+    inode_update(inode, size + offset, window);
+  } else {
+    rw_lock_acquire_read(&inode->meta_lock);
+    if (inode->data.unwritten_cnt > 0 || inode->data.cloned || inode->data.compressed) {
+      rw_lock_release_read(&inode->meta_lock);
+      rw_lock_acquire_write(&inode->meta_lock);
+      exclusive = true;
+    }
+  }
 
-    /* Bytes left in inode, bytes left in sector, lesser of the two. */
-    off_t inode_left = inode_length(inode) - offset;
-    int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-    int min_left = inode_left < sector_left ? inode_left : sector_left;
+  if (inode->data.compressed)
+    bytes_written = compressed_write(inode, buffer, size, offset);
+  else
+    while (size > 0) {
+      /* Sector to write, directing byte offset within sector. */
+      block_sector_t entry = map_entry(inode, offset);
+      block_sector_t sector_idx;
+      //printf("a at %d from %d through %d +\n", sector_idx, offset, inode->sector);
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      off_t inode_left = inode_length(inode) - offset;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int min_left = inode_left < sector_left ? inode_left : sector_left;
+
+      /* Number of bytes to actually write into this sector. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      /* A sector shared with a clone is copied first. */
+      if (inode->data.cloned &&
+          (entry = unshare(inode, offset, chunk_size < BLOCK_SECTOR_SIZE)) == (block_sector_t)-1)
+        break;
+      sector_idx = entry & ~UNWRITTEN;
+
+      if (entry & UNWRITTEN) {
+        /* First write to a preallocated sector: the rest of it must
+           read as zeros from now on. */
+        static char zeros[BLOCK_SECTOR_SIZE];
+
+        if (chunk_size < BLOCK_SECTOR_SIZE)
+          block_write(fs_device, sector_idx, zeros);
+        block_write_offsz(fs_device, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+        mark_written(inode, offset);
+      } else if (meta) {
+        /* Metadata is held in the cache until the journal commits it. */
+        block_write_meta(fs_device, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+      } else if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
+        /* Write full sector directly to disk. */
+        block_write(fs_device, sector_idx, buffer + bytes_written);
+      } else {
+
+        block_write_offsz(fs_device, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+      }
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
 
-    /* Number of bytes to actually write into this sector. */
-    int chunk_size = size < min_left ? size : min_left;
-    if (chunk_size <= 0)
-      break;
+  if (exclusive)
+    rw_lock_release_write(&inode->meta_lock);
+  else
+    rw_lock_release_read(&inode->meta_lock);
+  inode_range_unlock(inode, &range);
+  return bytes_written;
+}
 
-    if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE) {
-      /* Write full sector directly to disk. */
-      block_write(fs_device, sector_idx, buffer + bytes_written);
-    } else {
+/* Most sectors moved by one direct transfer. */
+#define DIRECT_RUN_MAX 64
+
+/* Moves the CNT whole sectors of INODE that start at byte OFFSET,
+   which is sector aligned, between INODE and BUFFER: into BUFFER
+   if WRITE is false, out of it if WRITE is true.  Runs of sectors
+   that are consecutive on disk, and either all written or all
+   UNWRITTEN, go straight to or from the device in one transfer
+   each, bypassing the cache; a written UNWRITTEN run then has its
+   block map pointers updated together.
+   INODE's meta_lock must be held, for writing if WRITE is true and
+   INODE has UNWRITTEN sectors. */
+static void direct_io(struct inode* inode, uint8_t* buffer, off_t offset, size_t cnt, bool write) {
+  size_t i = 0;
+
+  while (i < cnt) {
+    block_sector_t first = map_entry(inode, offset + i * BLOCK_SECTOR_SIZE);
+    uint8_t* p = buffer + i * BLOCK_SECTOR_SIZE;
+    size_t run;
+
+    /* UNWRITTEN is a flag bit, so a run of UNWRITTEN sectors
+       counts up from FIRST just as a run of written ones does. */
+    for (run = 1; i + run < cnt && run < DIRECT_RUN_MAX &&
+                  map_entry(inode, offset + (i + run) * BLOCK_SECTOR_SIZE) == first + run;
+         run++)
+      continue;
+    if (first & UNWRITTEN) {
+      if (write) {
+        block_write_direct(fs_device, first & ~UNWRITTEN, run, p);
+        mark_run_written(inode, offset + i * BLOCK_SECTOR_SIZE, run);
+      } else
+        memset(p, 0, run * BLOCK_SECTOR_SIZE);
+    } else if (write)
+      block_write_direct(fs_device, first, run, p);
+    else
+      block_read_direct(fs_device, first, run, p);
+    i += run;
+  }
+}
 
-      block_write_offsz(fs_device, sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
-    }
+/* Like inode_read_at(), but whole sectors are read straight from
+   the device into BUFFER, without passing through or displacing
+   the cache.  Only an unaligned head, and a tail that is not a
+   whole sector of the file, go through the cache, as does all of
+   a compressed file. */
+off_t inode_read_at_direct(struct inode* inode, void* buffer_, off_t size, off_t offset) {
+  uint8_t* buffer = buffer_;
+  off_t done = ROUND_UP(offset, BLOCK_SECTOR_SIZE) - offset;
+  struct inode_range range;
+  off_t end;
+
+  if (done > size)
+    done = size;
+  if (done > 0) {
+    off_t n = inode_read_at(inode, buffer, done, offset);
+    if (n < done)
+      return n;
+  }
 
-    /* Advance. */
-    size -= chunk_size;
-    offset += chunk_size;
-    bytes_written += chunk_size;
+  inode_range_lock(inode, &range, offset + done, offset + size, false);
+  rw_lock_acquire_read(&inode->meta_lock);
+  end = offset + size < inode_length(inode) ? offset + size : inode_length(inode);
+  if (!inode->data.compressed && end - (offset + done) >= BLOCK_SECTOR_SIZE) {
+    size_t cnt = (end - (offset + done)) / BLOCK_SECTOR_SIZE;
+    direct_io(inode, buffer + done, offset + done, cnt, false);
+    done += cnt * BLOCK_SECTOR_SIZE;
   }
+  rw_lock_release_read(&inode->meta_lock);
+  inode_range_unlock(inode, &range);
 
-  return bytes_written;
+  if (done < size)
+    done += inode_read_at(inode, buffer + done, size - done, offset + done);
+  return done;
+}
+
+/* Like inode_write_at(), but whole sectors are written straight
+   from BUFFER to the device, without passing through or
+   displacing the cache.  A write past end of file first grows
+   INODE with inode_preallocate(), so that the new part is laid
+   out contiguously.  Only an unaligned head and tail go through
+   the cache, as does all of a compressed file. */
+off_t inode_write_at_direct(struct inode* inode, const void* buffer_, off_t size, off_t offset) {
+  const uint8_t* buffer = buffer_;
+  off_t done = ROUND_UP(offset, BLOCK_SECTOR_SIZE) - offset;
+  struct inode_range range;
+  bool exclusive;
+  off_t end;
+
+  if (inode->deny_write_cnt || size <= 0)
+    return 0;
+  if (offset + size > inode_length(inode))
+    inode_preallocate(inode, offset + size);
+
+  if (done > size)
+    done = size;
+  if (done > 0 && inode_write_at(inode, buffer, done, offset) < done)
+    return 0;
+
+  /* UNWRITTEN sectors and clones can only appear while no one
+     holds the lock shared, so what is seen under it holds. */
+  inode_range_lock(inode, &range, offset + done, offset + size, true);
+  rw_lock_acquire_read(&inode->meta_lock);
+  exclusive = inode->data.unwritten_cnt > 0 || inode->data.cloned;
+  if (exclusive) {
+    rw_lock_release_read(&inode->meta_lock);
+    rw_lock_acquire_write(&inode->meta_lock);
+  }
+  end = offset + size < inode_length(inode) ? offset + size : inode_length(inode);
+  if (!inode->data.compressed && end - (offset + done) >= BLOCK_SECTOR_SIZE) {
+    size_t cnt = (end - (offset + done)) / BLOCK_SECTOR_SIZE;
+    size_t i;
+
+    /* Sectors shared with a clone are replaced, not copied, since
+       they are about to be overwritten whole. */
+    for (i = 0; inode->data.cloned && i < cnt; i++)
+      if (unshare(inode, offset + done + i * BLOCK_SECTOR_SIZE, false) == (block_sector_t)-1)
+        break;
+    if (inode->data.cloned)
+      cnt = i;
+    direct_io(inode, (uint8_t*)buffer + done, offset + done, cnt, true);
+    done += cnt * BLOCK_SECTOR_SIZE;
+  }
+  if (exclusive)
+    rw_lock_release_write(&inode->meta_lock);
+  else
+    rw_lock_release_read(&inode->meta_lock);
+  inode_range_unlock(inode, &range);
+
+  if (done < size)
+    done += inode_write_at(inode, buffer + done, size - done, offset + done);
+  return done;
 }
 
 /* Disables writes to INODE.
@@ -456,6 +1699,28 @@ void inode_allow_write(struct inode* inode) {
 }
 
 /* Returns the length, in bytes, of INODE's data. */
-off_t inode_length(const struct inode* inode) { return inode->length; }
+off_t inode_length(const struct inode* inode) { return inode->data.length; }
+
+bool inode_is_dir(struct inode* inode) { return inode->data.is_dir; }
+
+/* Returns the sector of directory INODE's hashed index, or 0 if
+   it has none. */
+block_sector_t inode_get_dir_index(struct inode* inode) {
+  block_sector_t sector;
+
+  rw_lock_acquire_read(&inode->meta_lock);
+  sector = inode->data.dir_index;
+  rw_lock_release_read(&inode->meta_lock);
+  return sector;
+}
+
+/* Makes SECTOR, or 0 for none, the hashed index of directory
+   INODE. */
+void inode_set_dir_index(struct inode* inode, block_sector_t sector) {
+  ASSERT(inode->data.is_dir);
 
-bool inode_is_dir(struct inode* inode) { return inode->is_dir; }
\ No newline at end of file
+  rw_lock_acquire_write(&inode->meta_lock);
+  inode->data.dir_index = sector;
+  inode->dirty = true;
+  rw_lock_release_write(&inode->meta_lock);
+}
\ No newline at end of file
@@ -6,6 +6,18 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct prealloc_window;
+
+/* Size of an on-disk inode.  Several are packed into each sector
+   of an inode table; see filesys/free-map.c. */
+#define INODE_DISK_SIZE 128
+
+/* Where a directory's free entry slots are, kept in memory with
+   its inode. */
+struct dir_slots {
+  off_t hint;   /* No free slot lies before this offset. */
+  int free_cnt; /* Number of free slots, or -1 if not counted yet. */
+};
 
 void inode_init(void);
 bool inode_create(block_sector_t sector, off_t length, bool is_dir);
@@ -13,13 +25,30 @@ struct inode* inode_open(block_sector_t);
 struct inode* inode_reopen(struct inode*);
 block_sector_t inode_get_inumber(const struct inode*);
 void inode_close(struct inode*);
+void inode_flush(struct inode*);
+void inode_flush_all(void);
+void inode_reclaim_wait(void);
 void inode_remove(struct inode*);
+void inode_truncate(struct inode*, off_t length);
+bool inode_preallocate(struct inode*, off_t length);
+void inode_reserve(struct inode*, off_t length, struct prealloc_window*);
+bool inode_clone(struct inode* dst, struct inode* src);
+bool inode_set_compressed(struct inode*, bool);
+bool inode_is_compressed(struct inode*);
+struct dir_slots* inode_dir_slots(struct inode*);
+void inode_set_journaled(struct inode*);
 off_t inode_read_at(struct inode*, void*, off_t size, off_t offset);
 off_t inode_write_at(struct inode*, const void*, off_t size, off_t offset);
+off_t inode_write_at_window(struct inode*, const void*, off_t size, off_t offset,
+                            struct prealloc_window*);
+off_t inode_read_at_direct(struct inode*, void*, off_t size, off_t offset);
+off_t inode_write_at_direct(struct inode*, const void*, off_t size, off_t offset);
 void inode_deny_write(struct inode*);
 void inode_allow_write(struct inode*);
 off_t inode_length(const struct inode*);
 bool inode_is_dir(struct inode*);
+block_sector_t inode_get_dir_index(struct inode*);
+void inode_set_dir_index(struct inode*, block_sector_t);
 bool inode_already_open(block_sector_t sector);
 
 #endif /* filesys/inode.h */
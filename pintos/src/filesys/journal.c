@@ -0,0 +1,234 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* A write-ahead journal for file system metadata.
+
+   Sectors written with block_write_meta() (inodes, indirect
+   blocks, directory contents and indexes, and the free map) are
+   held in the buffer cache, marked journaled, until a commit.  A
+   commit first writes ordinary dirty data home, then copies every
+   journaled sector into the journal area, then writes the journal
+   header, which makes the commit durable, and only then writes
+   the sectors to their home locations and clears the header.  A
+   crash after the header write is repaired at mount time by
+   replaying the journal; a crash before it leaves the previous,
+   consistent metadata in place.
+
+   Commits requested through journal_sync() are grouped: a caller
+   waits for one commit that started after it asked, and all the
+   callers that ask while a commit is being written share the
+   next one.
+
+   Every commit waits for the namespace operations in progress to
+   end, so that it never captures half of one, except when a
+   thread finds the cache entirely taken up by journaled sectors
+   from within an operation.  Journaled sectors are never evicted,
+   so the only way forward then is to commit what the cache
+   holds. */
+
+/* Journaled sectors the cache may hold before a writer commits
+   them, leaving the rest of the cache to ordinary data. */
+#define JOURNAL_HIGH_WATER (CACHE_SIZE / 2)
+
+static block_sector_t journal_start; /* Header sector, or 0 if there is no journal. */
+static struct journal_header* header; /* In-memory copy of the header. */
+static uint8_t* blocks;              /* Sectors being committed. */
+static uint32_t gens[JOURNAL_MAX];   /* Cache generation of each of BLOCKS. */
+static struct lock commit_lock;      /* Serializes commits. */
+
+/* Held shared by each namespace operation, and exclusively while
+   a commit takes its snapshot, so that commits never capture half
+   of an operation.  Each thread's journal_depth counts the times
+   it holds the barrier, so that it never waits for itself. */
+static struct rw_lock barrier;
+
+/* Group commit state. */
+static struct lock group_lock;       /* Protects the following. */
+static struct condition group_done;  /* Signaled when a commit ends. */
+static unsigned started;             /* Grouped commits started. */
+static unsigned finished;            /* Grouped commits finished. */
+static bool committing;              /* Grouped commit in progress? */
+
+static void commit(bool synchronous, bool exclusive);
+
+/* Initializes the journal module. */
+void journal_init(void) {
+  ASSERT(sizeof *header == BLOCK_SECTOR_SIZE);
+  header = malloc(sizeof *header);
+  blocks = malloc(JOURNAL_MAX * BLOCK_SECTOR_SIZE);
+  if (header == NULL || blocks == NULL)
+    PANIC("can't allocate journal buffers");
+  lock_init(&commit_lock);
+  rw_lock_init(&barrier);
+  lock_init(&group_lock);
+  cond_init(&group_done);
+  journal_start = 0;
+}
+
+/* Writes an empty journal to the JOURNAL_SECTORS sectors starting
+   at START and starts using it. */
+void journal_create(block_sector_t start) {
+  memset(header, 0, sizeof *header);
+  header->magic = JOURNAL_MAGIC;
+  block_write_raw(fs_device, start, header);
+  journal_start = start;
+}
+
+/* Starts using the journal at START, first replaying its last
+   commit if the system stopped before that commit's checkpoint
+   was complete.  Must be called before any metadata is read. */
+void journal_open(block_sector_t start) {
+  uint32_t i;
+
+  block_read_raw(fs_device, start, header);
+  if (header->magic != JOURNAL_MAGIC)
+    PANIC("journal at sector %" PRDSNu " is corrupt", start);
+
+  if (header->cnt > 0 && header->cnt <= JOURNAL_MAX) {
+    for (i = 0; i < header->cnt; i++)
+      block_read_raw(fs_device, start + 1 + i, blocks + i * BLOCK_SECTOR_SIZE);
+
+    /* A bad checksum means the commit never completed. */
+    if (hash_bytes(blocks, header->cnt * BLOCK_SECTOR_SIZE) == header->checksum)
+      for (i = 0; i < header->cnt; i++)
+        block_write_raw(fs_device, header->home[i], blocks + i * BLOCK_SECTOR_SIZE);
+  }
+  header->cnt = 0;
+  block_write_raw(fs_device, start, header);
+  journal_start = start;
+}
+
+/* Returns true if metadata goes through the journal. */
+bool journal_enabled(void) { return journal_start != 0; }
+
+/* Returns the journal's header sector, or 0 if there is no
+   journal. */
+block_sector_t journal_get_start(void) { return journal_start; }
+
+/* Acquires the barrier for writing, waiting until no namespace
+   operation is in progress.  The calling thread must not be in
+   one itself. */
+static void barrier_acquire(void) {
+  ASSERT(thread_current()->journal_depth == 0);
+  rw_lock_acquire_write(&barrier);
+  thread_current()->journal_depth++;
+}
+
+/* Releases the barrier acquired by barrier_acquire(). */
+static void barrier_release(void) {
+  thread_current()->journal_depth--;
+  rw_lock_release_write(&barrier);
+}
+
+/* Begins a namespace operation, one that changes several pieces of
+   metadata that must stay consistent with each other.  Makes room
+   in the cache first, since commits cannot while the operation is
+   in progress. */
+void journal_begin(void) {
+  if (journal_enabled() && filesys_cache.journaled_cnt >= JOURNAL_HIGH_WATER) {
+    barrier_acquire();
+    commit(false, true);
+  }
+  rw_lock_acquire_read(&barrier);
+  thread_current()->journal_depth++;
+}
+
+/* Ends a namespace operation. */
+void journal_end(void) {
+  thread_current()->journal_depth--;
+  rw_lock_release_read(&barrier);
+}
+
+/* Writes ordinary dirty data home, then commits the journaled
+   sectors in the cache.  Every commit first puts the changed
+   sectors of the free map, inode map and refcount file in the
+   cache, so that it carries the allocations behind the references
+   it commits.  A SYNCHRONOUS commit also writes back in-memory
+   inodes first.  If EXCLUSIVE, the caller holds the barrier
+   through barrier_acquire(), which is released once the snapshot
+   is taken. */
+static void commit(bool synchronous, bool exclusive) {
+  uint32_t cnt, i;
+
+  if (synchronous)
+    inode_flush_all();
+  free_map_flush();
+
+  lock_acquire(&commit_lock);
+  block_flush_data(fs_device);
+  cnt = cache_snapshot_journaled(&filesys_cache, blocks, header->home, gens);
+  if (exclusive)
+    barrier_release();
+
+  if (cnt > 0 && journal_enabled()) {
+    for (i = 0; i < cnt; i++)
+      block_write_raw(fs_device, journal_start + 1 + i, blocks + i * BLOCK_SECTOR_SIZE);
+    header->seq++;
+    header->cnt = cnt;
+    header->checksum = hash_bytes(blocks, cnt * BLOCK_SECTOR_SIZE);
+    block_write_raw(fs_device, journal_start, header);
+
+    /* Committed.  Checkpoint, then mark the journal empty so that
+       a later crash does not replay stale copies of sectors that
+       may have been freed and reused since. */
+    for (i = 0; i < cnt; i++)
+      block_write_raw(fs_device, header->home[i], blocks + i * BLOCK_SECTOR_SIZE);
+    header->cnt = 0;
+    block_write_raw(fs_device, journal_start, header);
+    cache_commit_journaled(&filesys_cache, header->home, gens, cnt);
+  }
+  lock_release(&commit_lock);
+}
+
+/* Commits the journaled sectors in the cache if they take up too
+   much of it.  Called before each metadata write, possibly with
+   inode locks held that a namespace operation in progress is
+   waiting for, so it never waits for the barrier: it leaves the
+   commit to the next operation to begin instead. */
+void journal_make_room(void) {
+  if (journal_enabled() && filesys_cache.journaled_cnt >= JOURNAL_HIGH_WATER &&
+      thread_current()->journal_depth == 0 && rw_lock_try_acquire_write(&barrier)) {
+    thread_current()->journal_depth++;
+    commit(false, true);
+  }
+}
+
+/* Commits the journaled sectors in the cache because they fill
+   it, so that nothing can be evicted to make room for another
+   sector.  Does not wait for the barrier, so this may commit part
+   of a namespace operation; with every slot waiting for the
+   journal there is no other way to go on. */
+void journal_commit_full(void) { commit(false, false); }
+
+/* Makes every change made to the file system before the call
+   durable.  Concurrent callers share commits. */
+void journal_sync(void) {
+  unsigned target;
+
+  lock_acquire(&group_lock);
+  target = started + 1;
+  while (finished < target) {
+    if (!committing) {
+      unsigned mine = ++started;
+
+      committing = true;
+      lock_release(&group_lock);
+      barrier_acquire();
+      commit(true, true);
+      lock_acquire(&group_lock);
+      finished = mine;
+      committing = false;
+      cond_broadcast(&group_done, &group_lock);
+    } else
+      cond_wait(&group_done, &group_lock);
+  }
+  lock_release(&group_lock);
+}
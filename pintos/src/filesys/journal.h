@@ -0,0 +1,42 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+#include "filesys/sector_cache.h"
+
+/* Number of sectors in the on-disk journal: a header followed by
+   room for every sector the cache can hold. */
+#define JOURNAL_SECTORS (1 + CACHE_SIZE)
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Most sectors in one commit: every sector the cache holds. */
+#define JOURNAL_MAX CACHE_SIZE
+
+/* On-disk journal header, in the first journal sector.  CNT is
+   nonzero only between a commit and the end of its checkpoint.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header {
+  unsigned magic;                     /* Magic number. */
+  uint32_t seq;                       /* Sequence number of the last commit. */
+  uint32_t cnt;                       /* Sectors to replay. */
+  unsigned checksum;                  /* hash_bytes() of the CNT journaled sectors. */
+  block_sector_t home[JOURNAL_MAX];   /* Home sector of each journaled sector. */
+  uint32_t unused[124 - JOURNAL_MAX]; /* Not used. */
+};
+
+void journal_init(void);
+void journal_create(block_sector_t start);
+void journal_open(block_sector_t start);
+bool journal_enabled(void);
+block_sector_t journal_get_start(void);
+
+void journal_begin(void);
+void journal_end(void);
+void journal_make_room(void);
+void journal_commit_full(void);
+void journal_sync(void);
+
+#endif /* filesys/journal.h */
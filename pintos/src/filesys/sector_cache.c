@@ -4,9 +4,17 @@
 void cache_init(sector_cache* cache) {
   //printf("INIT CACHE\n");
   for (int i = 0; i < CACHE_SIZE; i++)
-    cache->valid[i] = 0;
+    cache->valid[i] = 0, cache->journaled[i] = 0, cache->gen[i] = 0;
   cache->clock_hand = 0;
+  cache->journaled_cnt = 0;
   lock_init(&cache->cache_lock);
+  lock_init(&cache->miss_lock);
+}
+
+// lock must be held
+static void clear_journaled(sector_cache* cache, int i) {
+  if (cache->journaled[i])
+    cache->journaled[i] = 0, cache->journaled_cnt--;
 }
 
 // lock must be held
@@ -19,8 +27,16 @@ void increment_clock(int* clock) {
 
 uint8_t cache_evict_nolock(sector_cache* cache, void* buffer, block_sector_t* evicted_sector,
                            uint8_t* dirty) {
-  while (cache->valid[cache->clock_hand] && cache->recently_accessed[cache->clock_hand])
+  // journaled sectors are never evicted, since their home copy may only be
+  // written once the journal holds them; if two full sweeps find nothing
+  // else, the caller must commit the journal and try again
+  int steps = 0;
+  while (cache->valid[cache->clock_hand] &&
+         (cache->recently_accessed[cache->clock_hand] || cache->journaled[cache->clock_hand])) {
+    if (steps++ == 2 * CACHE_SIZE)
+      return CACHE_FULL;
     cache->recently_accessed[cache->clock_hand] = 0, increment_clock(&cache->clock_hand);
+  }
   *evicted_sector = cache->cached[cache->clock_hand];
   *dirty = cache->dirty[cache->clock_hand];
   uint8_t ret = 0;
@@ -28,15 +44,21 @@ uint8_t cache_evict_nolock(sector_cache* cache, void* buffer, block_sector_t* ev
     memcpy(buffer, &cache->buffer[BLOCK_SECTOR_SIZE * (cache->clock_hand)], BLOCK_SECTOR_SIZE),
         ret = 1;
   cache->valid[cache->clock_hand] = 0;
+  clear_journaled(cache, cache->clock_hand);
   //printf("REMOVING FROM CACHE %d with %d\n", *evicted_sector, ret);
   return ret;
 }
 
 // THERE MUST BE AN EMPTY BLOCK IN CACHE before calling this
 uint8_t cache_add(sector_cache* cache, void* buffer, block_sector_t sector, uint8_t dirty,
-                  block_sector_t* evicted_sector, uint8_t* dirty_evict, void* evicted_buffer) {
+                  uint8_t journaled, block_sector_t* evicted_sector, uint8_t* dirty_evict,
+                  void* evicted_buffer) {
   lock_acquire(&cache->cache_lock);
   uint8_t ret = cache_evict_nolock(cache, evicted_buffer, evicted_sector, dirty_evict);
+  if (ret == CACHE_FULL) {
+    lock_release(&cache->cache_lock);
+    return ret;
+  }
   while (cache->valid[cache->clock_hand])
     increment_clock(&cache->clock_hand);
 
@@ -45,13 +67,16 @@ uint8_t cache_add(sector_cache* cache, void* buffer, block_sector_t sector, uint
   memcpy(&cache->buffer[BLOCK_SECTOR_SIZE * (cache->clock_hand)], buffer, BLOCK_SECTOR_SIZE),
       cache->valid[cache->clock_hand] = 1, cache->recently_accessed[cache->clock_hand] = 1,
       cache->dirty[cache->clock_hand] = dirty, cache->cached[cache->clock_hand] = sector;
+  cache->gen[cache->clock_hand]++;
+  if (journaled)
+    cache->journaled[cache->clock_hand] = 1, cache->journaled_cnt++;
   increment_clock(&cache->clock_hand);
 
   lock_release(&cache->cache_lock);
   return ret;
 }
 
-// Gauranteed to remove a block from the cache if no empty block
+// Removes a block from the cache if no empty block, unless every block is journaled
 uint8_t cache_evict(sector_cache* cache, void* buffer, block_sector_t* evicted_sector,
                     uint8_t* dirty) {
   lock_acquire(&cache->cache_lock);
@@ -89,7 +114,8 @@ uint8_t cache_read(sector_cache* cache, block_sector_t sector, void* buffer, int
 }
 
 // returns true if sector exists in cache and writes it into buffer which must be atleast BLOCK_SECTOR_SIZE large
-uint8_t cache_write(sector_cache* cache, block_sector_t sector, void* buffer, int offset, int sz) {
+uint8_t cache_write(sector_cache* cache, block_sector_t sector, const void* buffer, int offset,
+                    int sz, uint8_t journaled) {
   lock_acquire(&cache->cache_lock);
   int i = cache_find_index(cache, sector);
   if (i == CACHE_SIZE) {
@@ -102,6 +128,9 @@ uint8_t cache_write(sector_cache* cache, block_sector_t sector, void* buffer, in
   memcpy(&cache->buffer[BLOCK_SECTOR_SIZE * (i) + offset], buffer, sz);
   cache->recently_accessed[i] = 1;
   cache->dirty[i] = 1;
+  cache->gen[i]++;
+  if (journaled && !cache->journaled[i])
+    cache->journaled[i] = 1, cache->journaled_cnt++;
   lock_release(&cache->cache_lock);
   return 1;
 }
@@ -117,8 +146,72 @@ uint8_t cache_get_dirty(sector_cache* cache, void* buffer, block_sector_t* secto
     *sector = cache->cached[ret];
     memcpy(buffer, &cache->buffer[BLOCK_SECTOR_SIZE * (ret)], BLOCK_SECTOR_SIZE);
     cache->valid[ret] = 0;
+    clear_journaled(cache, ret);
     ret = 1;
   }
   lock_release(&cache->cache_lock);
   return ret;
+}
+
+uint8_t cache_contains(sector_cache* cache, block_sector_t sector) {
+  lock_acquire(&cache->cache_lock);
+  uint8_t ret = cache_find_index(cache, sector) != CACHE_SIZE;
+  lock_release(&cache->cache_lock);
+  return ret;
+}
+
+void cache_discard(sector_cache* cache, block_sector_t sector) {
+  lock_acquire(&cache->cache_lock);
+  int i = cache_find_index(cache, sector);
+  if (i != CACHE_SIZE) {
+    cache->valid[i] = 0;
+    clear_journaled(cache, i);
+  }
+  lock_release(&cache->cache_lock);
+}
+
+uint8_t cache_get_dirty_data(sector_cache* cache, void* buffer, block_sector_t* sector) {
+  lock_acquire(&cache->cache_lock);
+  for (int i = 0; i < CACHE_SIZE; i++)
+    if (cache->valid[i] && cache->dirty[i] && !cache->journaled[i]) {
+      *sector = cache->cached[i];
+      memcpy(buffer, &cache->buffer[BLOCK_SECTOR_SIZE * i], BLOCK_SECTOR_SIZE);
+      cache->dirty[i] = 0;
+      lock_release(&cache->cache_lock);
+      return 1;
+    }
+  lock_release(&cache->cache_lock);
+  return 0;
+}
+
+int cache_snapshot_journaled(sector_cache* cache, void* buffers, block_sector_t* sectors,
+                             uint32_t* gens) {
+  uint8_t* out = buffers;
+  int cnt = 0;
+
+  lock_acquire(&cache->cache_lock);
+  for (int i = 0; i < CACHE_SIZE; i++)
+    if (cache->valid[i] && cache->journaled[i]) {
+      memcpy(out + BLOCK_SECTOR_SIZE * cnt, &cache->buffer[BLOCK_SECTOR_SIZE * i],
+             BLOCK_SECTOR_SIZE);
+      sectors[cnt] = cache->cached[i];
+      gens[cnt] = cache->gen[i];
+      cnt++;
+    }
+  lock_release(&cache->cache_lock);
+  return cnt;
+}
+
+void cache_commit_journaled(sector_cache* cache, const block_sector_t* sectors,
+                            const uint32_t* gens, int cnt) {
+  lock_acquire(&cache->cache_lock);
+  for (int j = 0; j < cnt; j++) {
+    int i = cache_find_index(cache, sectors[j]);
+    // the snapshot is now on disk at home, so an unchanged entry is clean
+    if (i != CACHE_SIZE && cache->gen[i] == gens[j]) {
+      cache->dirty[i] = 0;
+      clear_journaled(cache, i);
+    }
+  }
+  lock_release(&cache->cache_lock);
 }
\ No newline at end of file
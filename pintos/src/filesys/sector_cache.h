@@ -5,14 +5,28 @@
 #include "threads/synch.h"
 #define CACHE_SIZE 64
 
+// returned by cache_add() and cache_evict() when every entry is journaled,
+// so nothing can be evicted until the journal commits
+#define CACHE_FULL 2
+
 struct sector_cache {
   struct lock cache_lock;
+  // held while a missing sector is brought in, so a sector is never cached twice
+  struct lock miss_lock;
   block_sector_t cached[CACHE_SIZE];
   int clock_hand;
   uint8_t recently_accessed[CACHE_SIZE];
   uint8_t buffer[BLOCK_SECTOR_SIZE * CACHE_SIZE];
   uint8_t dirty[CACHE_SIZE];
   uint8_t valid[CACHE_SIZE];
+  // metadata sectors written since the last journal commit; these
+  // are never evicted, since their home copy may only be written
+  // once the journal holds them
+  uint8_t journaled[CACHE_SIZE];
+  // bumped on every write, so a commit can tell whether an entry
+  // changed while it was being written to the journal
+  uint32_t gen[CACHE_SIZE];
+  int journaled_cnt;
 };
 
 typedef struct sector_cache sector_cache;
@@ -20,10 +34,13 @@ typedef struct sector_cache sector_cache;
 void cache_init(sector_cache* cache);
 
 // THERE MUST BE AN EMPTY BLOCK IN CACHE before calling this
+// JOURNALED marks a dirty metadata sector
+// returns CACHE_FULL without adding the sector if nothing could be evicted
 uint8_t cache_add(sector_cache* cache, void* buffer, block_sector_t sector, uint8_t dirty,
-                  block_sector_t* evicted_sector, uint8_t* dirty_evict, void* evicted_buffer);
+                  uint8_t journaled, block_sector_t* evicted_sector, uint8_t* dirty_evict,
+                  void* evicted_buffer);
 
-// Gauranteed to remove a block from the cache
+// Removes a block from the cache, unless every block is journaled (CACHE_FULL)
 uint8_t cache_evict(sector_cache* cache, void* buffer, block_sector_t* evicted_sector,
                     uint8_t* dirty);
 
@@ -31,7 +48,27 @@ uint8_t cache_evict(sector_cache* cache, void* buffer, block_sector_t* evicted_s
 uint8_t cache_read(sector_cache* cache, block_sector_t sector, void* buffer, int offset, int sz);
 
 // returns true if sector exists in cache and writes it into buffer which must be atleast BLOCK_SECTOR_SIZE large
-uint8_t cache_write(sector_cache* cache, block_sector_t sector, void* buffer, int offset, int sz);
+// JOURNALED marks the sector as metadata until the next journal commit
+uint8_t cache_write(sector_cache* cache, block_sector_t sector, const void* buffer, int offset,
+                    int sz, uint8_t journaled);
 
 uint8_t cache_get_dirty(sector_cache* cache, void* buffer, block_sector_t* sector);
+
+// returns true if sector is in cache
+uint8_t cache_contains(sector_cache* cache, block_sector_t sector);
+
+// drops sector from the cache, dirty or not
+void cache_discard(sector_cache* cache, block_sector_t sector);
+
+// copies one dirty sector that is not journaled into buffer and marks it clean, keeping it cached
+uint8_t cache_get_dirty_data(sector_cache* cache, void* buffer, block_sector_t* sector);
+
+// copies every journaled sector into buffers, one BLOCK_SECTOR_SIZE each, along with its
+// sector number and generation; returns how many there were
+int cache_snapshot_journaled(sector_cache* cache, void* buffers, block_sector_t* sectors,
+                             uint32_t* gens);
+
+// marks the CNT sectors of a snapshot clean and no longer journaled, except those written since
+void cache_commit_journaled(sector_cache* cache, const block_sector_t* sectors,
+                            const uint32_t* gens, int cnt);
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+/* Directory entry as returned by the getdents system call, shared
+   by the kernel and user programs. */
+
+/* Maximum characters in a file name in a struct dirent. */
+#define DIRENT_NAME_MAX 14
+
+/* Values for d_type. */
+#define DT_REG 1 /* Ordinary file. */
+#define DT_DIR 2 /* Directory. */
+
+struct dirent {
+  int d_ino;                         /* Inode number. */
+  int d_type;                        /* DT_REG or DT_DIR. */
+  int d_size;                        /* Size in bytes. */
+  char d_name[DIRENT_NAME_MAX + 1];  /* Null-terminated file name. */
+};
+
+#endif /* lib/dirent.h */
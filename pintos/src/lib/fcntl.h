@@ -0,0 +1,15 @@
+#ifndef __LIB_FCNTL_H
+#define __LIB_FCNTL_H
+
+/* Commands and flags for the fcntl system call, shared by the
+   kernel and user programs. */
+
+/* Commands. */
+#define F_GETFL 1 /* Returns the file status flags. */
+#define F_SETFL 2 /* Sets the file status flags to the argument. */
+
+/* File status flags. */
+#define O_DIRECT 040000     /* Transfer whole sectors without the buffer cache. */
+#define O_COMPRESS 01000000 /* Store the file's data compressed. */
+
+#endif /* lib/fcntl.h */
@@ -23,10 +23,16 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   On top of the bits sits a summary level with one bit per
+   element of BITS, set if every bit in that element is set.
+   Searches for unset bits use it to step over ELEM_BITS full
+   elements, that is ELEM_BITS * ELEM_BITS bits, at a time. */
 struct bitmap {
   size_t bit_cnt;  /* Number of bits. */
   elem_type* bits; /* Elements that represent bits. */
+  elem_type* full; /* Summary: bit I set if BITS[I] is full. */
 };
 
 /* Returns the index of the element that contains the bit
@@ -50,6 +56,70 @@ static inline elem_type last_mask(const struct bitmap* b) {
   return last_bits ? ((elem_type)1 << last_bits) - 1 : (elem_type)-1;
 }
 
+/* Returns the number of bytes required for the summary of a
+   bitmap with BIT_CNT bits. */
+static inline size_t summary_byte_cnt(size_t bit_cnt) { return byte_cnt(elem_cnt(bit_cnt)); }
+
+/* Returns the index of the lowest set bit in WORD, which must
+   not be zero.  Compiles to a single BSF instruction. */
+static inline size_t lowest_bit(elem_type word) { return __builtin_ctzl(word); }
+
+/* Brings B's summary bit for element IDX up to date. */
+static inline void update_summary(struct bitmap* b, size_t idx) {
+  elem_type used = idx == elem_cnt(b->bit_cnt) - 1 ? last_mask(b) : (elem_type)-1;
+
+  if ((b->bits[idx] & used) == used)
+    b->full[elem_idx(idx)] |= bit_mask(idx);
+  else
+    b->full[elem_idx(idx)] &= ~bit_mask(idx);
+}
+
+/* Returns the index of the first element of B at or after IDX,
+   and before element CNT, that is not full, or CNT if there is
+   none.  Looks only at the summary. */
+static size_t next_nonfull_elem(const struct bitmap* b, size_t idx, size_t cnt) {
+  size_t s = elem_idx(idx);
+  elem_type word;
+
+  if (idx >= cnt)
+    return cnt;
+  word = ~b->full[s] & ~(bit_mask(idx) - 1);
+  while (word == 0) {
+    if (++s >= elem_cnt(cnt))
+      return cnt;
+    word = ~b->full[s];
+  }
+  idx = s * ELEM_BITS + lowest_bit(word);
+  return idx < cnt ? idx : cnt;
+}
+
+/* Returns the index of the first bit in B at or after START, and
+   before END, that is set to VALUE, or END if there is none.
+   Examines a whole element per step, and when looking for unset
+   bits skips full elements through the summary.  END must not
+   exceed B's size. */
+static size_t find_next(const struct bitmap* b, size_t start, size_t end, bool value) {
+  size_t cnt = elem_cnt(end);
+  elem_type flip = value ? 0 : (elem_type)-1;
+  size_t idx, bit;
+  elem_type word;
+
+  if (start >= end)
+    return end;
+
+  idx = elem_idx(start);
+  word = (b->bits[idx] ^ flip) & ~(bit_mask(start) - 1);
+  while (word == 0) {
+    idx = value ? idx + 1 : next_nonfull_elem(b, idx + 1, cnt);
+    if (idx >= cnt)
+      return end;
+    word = b->bits[idx] ^ flip;
+  }
+
+  bit = idx * ELEM_BITS + lowest_bit(word);
+  return bit < end ? bit : end;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -61,10 +131,13 @@ struct bitmap* bitmap_create(size_t bit_cnt) {
   if (b != NULL) {
     b->bit_cnt = bit_cnt;
     b->bits = malloc(byte_cnt(bit_cnt));
-    if (b->bits != NULL || bit_cnt == 0) {
+    b->full = malloc(summary_byte_cnt(bit_cnt));
+    if ((b->bits != NULL && b->full != NULL) || bit_cnt == 0) {
       bitmap_set_all(b, false);
       return b;
     }
+    free(b->bits);
+    free(b->full);
     free(b);
   }
   return NULL;
@@ -80,19 +153,23 @@ struct bitmap* bitmap_create_in_buf(size_t bit_cnt, void* block, size_t block_si
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type*)(b + 1);
+  b->full = b->bits + elem_cnt(bit_cnt);
   bitmap_set_all(b, false);
   return b;
 }
 
 /* Returns the number of bytes required to accomodate a bitmap
    with BIT_CNT bits (for use with bitmap_create_in_buf()). */
-size_t bitmap_buf_size(size_t bit_cnt) { return sizeof(struct bitmap) + byte_cnt(bit_cnt); }
+size_t bitmap_buf_size(size_t bit_cnt) {
+  return sizeof(struct bitmap) + byte_cnt(bit_cnt) + summary_byte_cnt(bit_cnt);
+}
 
 /* Destroys bitmap B, freeing its storage.
    Not for use on bitmaps created by bitmap_create_in_buf(). */
 void bitmap_destroy(struct bitmap* b) {
   if (b != NULL) {
     free(b->bits);
+    free(b->full);
     free(b);
   }
 }
@@ -104,7 +181,8 @@ size_t bitmap_size(const struct bitmap* b) { return b->bit_cnt; }
 
 /* Setting and testing single bits. */
 
-/* Atomically sets the bit numbered IDX in B to VALUE. */
+/* Sets the bit numbered IDX in B to VALUE.  Not atomic: see
+   bitmap_mark(). */
 void bitmap_set(struct bitmap* b, size_t idx, bool value) {
   ASSERT(b != NULL);
   ASSERT(idx < b->bit_cnt);
@@ -114,39 +192,47 @@ void bitmap_set(struct bitmap* b, size_t idx, bool value) {
     bitmap_reset(b, idx);
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to true. */
+/* Sets the bit numbered BIT_IDX in B to true.  The bit itself
+   is set atomically on a uniprocessor machine, but updating the
+   full-element summary afterward is a separate step, so callers
+   that share B must serialize changes to it themselves. */
 void bitmap_mark(struct bitmap* b, size_t bit_idx) {
   size_t idx = elem_idx(bit_idx);
   elem_type mask = bit_mask(bit_idx);
 
   /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
+     is atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm("orl %1, %0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+  update_summary(b, idx);
 }
 
-/* Atomically sets the bit numbered BIT_IDX in B to false. */
+/* Sets the bit numbered BIT_IDX in B to false.  Not atomic: see
+   bitmap_mark(). */
 void bitmap_reset(struct bitmap* b, size_t bit_idx) {
   size_t idx = elem_idx(bit_idx);
   elem_type mask = bit_mask(bit_idx);
 
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
+     is atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm("andl %1, %0" : "=m"(b->bits[idx]) : "r"(~mask) : "cc");
+  update_summary(b, idx);
 }
 
-/* Atomically toggles the bit numbered IDX in B;
+/* Toggles the bit numbered IDX in B;
    that is, if it is true, makes it false,
-   and if it is false, makes it true. */
+   and if it is false, makes it true.  Not atomic: see
+   bitmap_mark(). */
 void bitmap_flip(struct bitmap* b, size_t bit_idx) {
   size_t idx = elem_idx(bit_idx);
   elem_type mask = bit_mask(bit_idx);
 
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
+     is atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm("xorl %1, %0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+  update_summary(b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -165,7 +251,8 @@ void bitmap_set_all(struct bitmap* b, bool value) {
   bitmap_set_multiple(b, 0, bitmap_size(b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Whole elements inside the range are set a word at a time. */
 void bitmap_set_multiple(struct bitmap* b, size_t start, size_t cnt, bool value) {
   size_t i;
 
@@ -173,8 +260,17 @@ void bitmap_set_multiple(struct bitmap* b, size_t start, size_t cnt, bool value)
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set(b, start + i, value);
+  for (i = 0; i < cnt;) {
+    size_t bit = start + i;
+    if (bit % ELEM_BITS == 0 && cnt - i >= ELEM_BITS) {
+      b->bits[elem_idx(bit)] = value ? (elem_type)-1 : 0;
+      update_summary(b, elem_idx(bit));
+      i += ELEM_BITS;
+    } else {
+      bitmap_set(b, bit, value);
+      i++;
+    }
+  }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -196,16 +292,11 @@ size_t bitmap_count(const struct bitmap* b, size_t start, size_t cnt, bool value
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool bitmap_contains(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
-
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_next(b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -231,19 +322,39 @@ bool bitmap_all(const struct bitmap* b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Jumps from one run of VALUE bits to the next instead of trying
+   every start position, so the cost is proportional to the
+   number of elements and runs examined, not to their bits. */
 size_t bitmap_scan(const struct bitmap* b, size_t start, size_t cnt, bool value) {
   ASSERT(b != NULL);
-  ASSERT(start <= b->bit_cnt);
+  return bitmap_scan_range(b, start, b->bit_cnt, cnt, value);
+}
 
-  if (cnt <= b->bit_cnt) {
-    size_t last = b->bit_cnt - cnt;
-    size_t i;
-    for (i = start; i <= last; i++)
-      if (!bitmap_contains(b, i, cnt, !value))
-        return i;
+/* Like bitmap_scan(), but only finds a group that lies wholly
+   before bit END, and examines no bits at or past END. */
+size_t bitmap_scan_range(const struct bitmap* b, size_t start, size_t end, size_t cnt,
+                         bool value) {
+  size_t run, stop;
+
+  ASSERT(b != NULL);
+  ASSERT(start <= end);
+  ASSERT(end <= b->bit_cnt);
+
+  if (cnt > end - start)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  for (;;) {
+    run = find_next(b, start, end, value);
+    if (run + cnt > end)
+      return BITMAP_ERROR;
+    stop = find_next(b, run, run + cnt, !value);
+    if (stop - run >= cnt)
+      return run;
+    start = stop;
   }
-  return BITMAP_ERROR;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -251,8 +362,8 @@ size_t bitmap_scan(const struct bitmap* b, size_t start, size_t cnt, bool value)
    and returns the index of the first bit in the group.
    If there is no such group, returns BITMAP_ERROR.
    If CNT is zero, returns 0.
-   Bits are set atomically, but testing bits is not atomic with
-   setting them. */
+   Neither testing nor setting the bits is atomic, so callers
+   that share B must serialize access to it. */
 size_t bitmap_scan_and_flip(struct bitmap* b, size_t start, size_t cnt, bool value) {
   size_t idx = bitmap_scan(b, start, cnt, value);
   if (idx != BITMAP_ERROR)
@@ -272,8 +383,12 @@ bool bitmap_read(struct bitmap* b, struct file* file) {
   bool success = true;
   if (b->bit_cnt > 0) {
     off_t size = byte_cnt(b->bit_cnt);
+    size_t i;
+
     success = file_read_at(file, b->bits, size, 0) == size;
     b->bits[elem_cnt(b->bit_cnt) - 1] &= last_mask(b);
+    for (i = 0; i < elem_cnt(b->bit_cnt); i++)
+      update_summary(b, i);
   }
   return success;
 }
@@ -284,6 +399,14 @@ bool bitmap_write(const struct bitmap* b, struct file* file) {
   off_t size = byte_cnt(b->bit_cnt);
   return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Writes only the SIZE bytes at byte offset OFS of B's file image
+   to the same offset in FILE.  Bit K of B is in byte K / CHAR_BIT
+   of the image.  Return true if successful, false otherwise. */
+bool bitmap_write_part(const struct bitmap* b, struct file* file, size_t ofs, size_t size) {
+  ASSERT(ofs + size <= byte_cnt(b->bit_cnt));
+  return file_write_at(file, (const uint8_t*)b->bits + ofs, size, ofs) == (off_t)size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
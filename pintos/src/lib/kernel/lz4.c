@@ -0,0 +1,178 @@
+#include "lz4.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Shortest match worth encoding. */
+#define MIN_MATCH 4
+
+/* The format requires the last LAST_LITERALS bytes of a block to
+   be literals, and no match to start in the last MATCH_LIMIT. */
+#define LAST_LITERALS 5
+#define MATCH_LIMIT 12
+
+/* Largest offset a match can have. */
+#define MAX_OFFSET 65535
+
+/* Returns the 4 bytes at P as an integer. */
+static inline uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+/* Returns the hash table slot for the 4 bytes V. */
+static inline size_t hash4(uint32_t v) { return (v * 2654435761u) >> (32 - LZ4_HASH_BITS); }
+
+/* Appends the part of length LEN, after the 4 bits kept in a
+   sequence's token, to *OP as a run of 255s and a final byte
+   below 255, if LEN is 15 or more.  Returns false if that would
+   pass END. */
+static bool put_length(uint8_t** op, uint8_t* end, size_t len) {
+  if (len < 15)
+    return true;
+  for (len -= 15; len >= 255; len -= 255) {
+    if (*op >= end)
+      return false;
+    *(*op)++ = 255;
+  }
+  if (*op >= end)
+    return false;
+  *(*op)++ = len;
+  return true;
+}
+
+/* Appends a sequence to *OP: the LIT_LEN literal bytes at LIT,
+   followed, if MATCH_LEN is nonzero, by a match MATCH_LEN bytes
+   long at OFFSET bytes back.  Returns false if the sequence would
+   pass END. */
+static bool put_sequence(uint8_t** op, uint8_t* end, const uint8_t* lit, size_t lit_len,
+                         size_t offset, size_t match_len) {
+  size_t ml = match_len > 0 ? match_len - MIN_MATCH : 0;
+  uint8_t* token = *op;
+
+  if (*op >= end)
+    return false;
+  (*op)++;
+  *token = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+  if (!put_length(op, end, lit_len) || (size_t)(end - *op) < lit_len)
+    return false;
+  memcpy(*op, lit, lit_len);
+  *op += lit_len;
+
+  if (match_len > 0) {
+    if (end - *op < 2)
+      return false;
+    *(*op)++ = offset & 0xff;
+    *(*op)++ = offset >> 8;
+    if (!put_length(op, end, ml))
+      return false;
+  }
+  return true;
+}
+
+/* Compresses the SRC_LEN bytes at SRC into DST, which has room
+   for DST_CAP bytes, using TABLE as scratch space.  Matches are
+   found greedily, through a hash of the next 4 bytes at each
+   position.
+   Returns the number of bytes written to DST, or 0 if the
+   compressed block does not fit in DST_CAP bytes. */
+size_t lz4_compress(const void* src_, size_t src_len, void* dst_, size_t dst_cap,
+                    uint16_t table[LZ4_TABLE_SIZE]) {
+  const uint8_t* src = src_;
+  uint8_t* op = dst_;
+  uint8_t* end = op + dst_cap;
+  size_t anchor = 0; /* Start of literals not yet written. */
+  size_t ip = 0;     /* Position being matched. */
+
+  ASSERT(src_len <= LZ4_MAX_INPUT);
+
+  memset(table, 0, LZ4_TABLE_SIZE * sizeof *table);
+  if (src_len > MATCH_LIMIT)
+    while (ip < src_len - MATCH_LIMIT) {
+      uint32_t v = read32(src + ip);
+      size_t h = hash4(v);
+      size_t ref = table[h];
+      size_t len;
+
+      table[h] = ip;
+      if (ref >= ip || ip - ref > MAX_OFFSET || read32(src + ref) != v) {
+        ip++;
+        continue;
+      }
+
+      for (len = MIN_MATCH; ip + len < src_len - LAST_LITERALS && src[ref + len] == src[ip + len];
+           len++)
+        continue;
+      if (!put_sequence(&op, end, src + anchor, ip - anchor, ip - ref, len))
+        return 0;
+      ip += len;
+      anchor = ip;
+    }
+
+  if (!put_sequence(&op, end, src + anchor, src_len - anchor, 0, 0))
+    return 0;
+  return op - (uint8_t*)dst_;
+}
+
+/* Reads the part of a length past the 4 bits kept in a token from
+   *IP, which must not pass END, and adds it to *LEN.  Returns
+   false if the input ends first. */
+static bool get_length(const uint8_t** ip, const uint8_t* end, size_t* len) {
+  uint8_t b;
+
+  if (*len < 15)
+    return true;
+  do {
+    if (*ip >= end)
+      return false;
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+/* Decompresses the SRC_LEN-byte block at SRC into DST, which has
+   room for DST_CAP bytes.  Every length and offset is checked, so
+   that corrupt input cannot make it read or write out of bounds.
+   Returns the number of bytes written to DST, or LZ4_ERROR if the
+   block is malformed or does not fit in DST_CAP bytes. */
+size_t lz4_decompress(const void* src, size_t src_len, void* dst_, size_t dst_cap) {
+  const uint8_t* ip = src;
+  const uint8_t* ip_end = ip + src_len;
+  uint8_t* dst = dst_;
+  size_t op = 0;
+
+  while (ip < ip_end) {
+    uint8_t token = *ip++;
+    size_t lit_len = token >> 4;
+    size_t match_len = token & 15;
+    size_t offset;
+
+    if (!get_length(&ip, ip_end, &lit_len) || (size_t)(ip_end - ip) < lit_len ||
+        dst_cap - op < lit_len)
+      return LZ4_ERROR;
+    memcpy(dst + op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+
+    /* The last sequence has no match. */
+    if (ip == ip_end)
+      break;
+
+    if (ip_end - ip < 2)
+      return LZ4_ERROR;
+    offset = ip[0] | ip[1] << 8;
+    ip += 2;
+    if (!get_length(&ip, ip_end, &match_len))
+      return LZ4_ERROR;
+    match_len += MIN_MATCH;
+    if (offset == 0 || offset > op || dst_cap - op < match_len)
+      return LZ4_ERROR;
+
+    /* Byte by byte, since the copy may overlap its source. */
+    for (; match_len > 0; match_len--, op++)
+      dst[op] = dst[op - offset];
+  }
+  return op;
+}
@@ -0,0 +1,34 @@
+#ifndef __LIB_KERNEL_LZ4_H
+#define __LIB_KERNEL_LZ4_H
+
+/* LZ4 block compression.
+
+   Compresses and decompresses single blocks in the LZ4 block
+   format: a series of sequences, each a run of literal bytes
+   followed by a copy of earlier output.  The format favors speed
+   over ratio, so decompressing costs little more than copying,
+   which makes it suitable for data read from a slow disk.
+
+   Blocks are limited to LZ4_MAX_INPUT bytes, which lets the
+   compressor's hash table hold 16-bit positions. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest block that can be compressed. */
+#define LZ4_MAX_INPUT 65535
+
+/* Number of entries in the hash table that lz4_compress() uses
+   to find matches.  Larger tables find more matches in larger
+   blocks. */
+#define LZ4_HASH_BITS 10
+#define LZ4_TABLE_SIZE (1 << LZ4_HASH_BITS)
+
+/* Returned by lz4_decompress() for malformed input. */
+#define LZ4_ERROR ((size_t)-1)
+
+size_t lz4_compress(const void* src, size_t src_len, void* dst, size_t dst_cap,
+                    uint16_t table[LZ4_TABLE_SIZE]);
+size_t lz4_decompress(const void* src, size_t src_len, void* dst, size_t dst_cap);
+
+#endif /* lib/kernel/lz4.h */
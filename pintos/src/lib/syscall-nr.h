@@ -27,8 +27,19 @@ enum {
   SYS_CHDIR,   /* Change the current directory. */
   SYS_MKDIR,   /* Create a directory. */
   SYS_READDIR, /* Reads a directory entry. */
-  SYS_ISDIR,   /* Tests if a fd represents a directory. */
-  SYS_INUMBER  /* Returns the inode number for a fd. */
+  SYS_ISDIR,    /* Tests if a fd represents a directory. */
+  SYS_INUMBER,  /* Returns the inode number for a fd. */
+  SYS_GETDENTS, /* Reads several directory entries with attributes. */
+  SYS_FSYNC,    /* Makes a file's changes durable. */
+  SYS_SYNC,     /* Makes all file system changes durable. */
+  SYS_PREAD,    /* Read from a file at a given position. */
+  SYS_PWRITE,   /* Write to a file at a given position. */
+  SYS_READV,    /* Read from a file into several buffers. */
+  SYS_WRITEV,   /* Write to a file from several buffers. */
+  SYS_COPY_FILE_RANGE, /* Copy data between files in the kernel. */
+  SYS_FALLOCATE,       /* Reserve space for a file. */
+  SYS_FCNTL,           /* Get or set file status flags. */
+  SYS_CLONE_FILE       /* Make a copy-on-write clone of a file. */
 };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,18 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+#include <stddef.h>
+
+/* One buffer of a vectored read or write, as passed to the readv
+   and writev system calls, shared by the kernel and user
+   programs. */
+
+/* Most buffers in one readv or writev call. */
+#define IOV_MAX 32
+
+struct iovec {
+  void* iov_base; /* Start of the buffer. */
+  size_t iov_len; /* Size of the buffer in bytes. */
+};
+
+#endif /* lib/uio.h */
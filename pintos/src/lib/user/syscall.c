@@ -1,15 +1,56 @@
 #include <syscall.h>
 #include "../syscall-nr.h"
 
+/* How syscall_entry enters the kernel. */
+enum syscall_method {
+  SYSCALL_UNKNOWN, /* Not decided yet. */
+  SYSCALL_INT,     /* int $0x30. */
+  SYSCALL_SYSENTER /* SYSENTER, returning through SYSEXIT. */
+};
+
+static enum syscall_method syscall_method __attribute__((used)) = SYSCALL_UNKNOWN;
+
+/* Picks SYSENTER if the CPU has it, with the same test as the
+   kernel's syscall_init(), or int $0x30 otherwise. */
+static void __attribute__((used)) syscall_pick_method(void) {
+  unsigned eax = 1, ebx, ecx = 0, edx;
+
+  asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+  syscall_method = (edx & (1 << 11)) != 0 && (eax & 0x0fff3fff) >= 0x633 ? SYSCALL_SYSENTER
+                                                                          : SYSCALL_INT;
+}
+
+/* Enters the kernel for the system call whose number and
+   arguments are on the stack just above the return address.  The
+   return address is popped first, so that the kernel finds them
+   at the stack pointer just as from an inline int $0x30.  With
+   SYSENTER, the kernel returns straight to the caller through
+   SYSEXIT, which takes the stack pointer from %ecx and the return
+   address from %edx.  Either way %ecx and %edx are clobbered. */
+asm(".text\n"
+    "syscall_entry:\n"
+    "  cmpl $0, syscall_method\n"
+    "  jne 1f\n"
+    "  call syscall_pick_method\n"
+    "1:\n"
+    "  popl %edx\n"
+    "  cmpl $2, syscall_method\n"
+    "  jne 2f\n"
+    "  movl %esp, %ecx\n"
+    "  sysenter\n"
+    "2:\n"
+    "  int $0x30\n"
+    "  jmp *%edx\n");
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                                                           \
   ({                                                                                               \
     int retval;                                                                                    \
-    asm volatile("pushl %[number]; int $0x30; addl $4, %%esp"                                      \
+    asm volatile("pushl %[number]; call syscall_entry; addl $4, %%esp"                             \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER)                                                            \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
@@ -18,10 +59,10 @@
 #define syscall1(NUMBER, ARG0)                                                                     \
   ({                                                                                               \
     int retval;                                                                                    \
-    asm volatile("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp"                       \
+    asm volatile("pushl %[arg0]; pushl %[number]; call syscall_entry; addl $8, %%esp"              \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER), [arg0] "g"(ARG0)                                          \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
@@ -31,10 +72,10 @@
   ({                                                                                               \
     int retval;                                                                                    \
     asm volatile("pushl %[arg1]; pushl %[arg0]; "                                                  \
-                 "pushl %[number]; int $0x30; addl $12, %%esp"                                     \
+                 "pushl %[number]; call syscall_entry; addl $12, %%esp"                            \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1)                        \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
@@ -44,10 +85,24 @@
   ({                                                                                               \
     int retval;                                                                                    \
     asm volatile("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "                                   \
-                 "pushl %[number]; int $0x30; addl $16, %%esp"                                     \
+                 "pushl %[number]; call syscall_entry; addl $16, %%esp"                            \
                  : "=a"(retval)                                                                    \
                  : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1), [arg2] "r"(ARG2)      \
-                 : "memory");                                                                      \
+                 : "ecx", "edx", "memory");                                                        \
+    retval;                                                                                        \
+  })
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                                                   \
+  ({                                                                                               \
+    int retval;                                                                                    \
+    asm volatile("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "                    \
+                 "pushl %[number]; call syscall_entry; addl $20, %%esp"                            \
+                 : "=a"(retval)                                                                    \
+                 : [number] "i"(NUMBER), [arg0] "r"(ARG0), [arg1] "r"(ARG1), [arg2] "r"(ARG2),     \
+                   [arg3] "r"(ARG3)                                                                \
+                 : "ecx", "edx", "memory");                                                        \
     retval;                                                                                        \
   })
 
@@ -102,3 +157,39 @@ bool readdir(int fd, char name[READDIR_MAX_LEN + 1]) { return syscall2(SYS_READD
 bool isdir(int fd) { return syscall1(SYS_ISDIR, fd); }
 
 int inumber(int fd) { return syscall1(SYS_INUMBER, fd); }
+
+int getdents(int fd, struct dirent* entries, unsigned cnt) {
+  return syscall3(SYS_GETDENTS, fd, entries, cnt);
+}
+
+bool fsync(int fd) { return syscall1(SYS_FSYNC, fd); }
+
+void sync(void) { syscall0(SYS_SYNC); }
+
+int pread(int fd, void* buffer, unsigned size, unsigned position) {
+  return syscall4(SYS_PREAD, fd, buffer, size, position);
+}
+
+int pwrite(int fd, const void* buffer, unsigned size, unsigned position) {
+  return syscall4(SYS_PWRITE, fd, buffer, size, position);
+}
+
+int readv(int fd, const struct iovec* iov, int iovcnt) {
+  return syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+int writev(int fd, const struct iovec* iov, int iovcnt) {
+  return syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int copy_file_range(int fd_in, int fd_out, unsigned size) {
+  return syscall3(SYS_COPY_FILE_RANGE, fd_in, fd_out, size);
+}
+
+bool fallocate(int fd, unsigned offset, unsigned len) {
+  return syscall3(SYS_FALLOCATE, fd, offset, len);
+}
+
+int fcntl(int fd, int cmd, int arg) { return syscall3(SYS_FCNTL, fd, cmd, arg); }
+
+bool clone_file(int src_fd, int dst_fd) { return syscall2(SYS_CLONE_FILE, src_fd, dst_fd); }
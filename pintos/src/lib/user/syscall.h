@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,5 +48,16 @@ bool mkdir(const char* dir);
 bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
+int getdents(int fd, struct dirent* entries, unsigned cnt);
+bool fsync(int fd);
+void sync(void);
+int pread(int fd, void* buffer, unsigned size, unsigned position);
+int pwrite(int fd, const void* buffer, unsigned size, unsigned position);
+int readv(int fd, const struct iovec* iov, int iovcnt);
+int writev(int fd, const struct iovec* iov, int iovcnt);
+int copy_file_range(int fd_in, int fd_out, unsigned size);
+bool fallocate(int fd, unsigned offset, unsigned len);
+int fcntl(int fd, int cmd, int arg);
+bool clone_file(int src_fd, int dst_fd);
 
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,68 @@
+/* Clones a file, writes to each side of the clone and checks
+   that the other side did not change, then removes both and
+   checks that every sector they used went back to the free map,
+   by filling the disk before and after. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 5120
+static char data[FILE_SIZE];
+static char data_a[FILE_SIZE];
+static char data_b[FILE_SIZE];
+static char fill[4096];
+
+/* Returns the number of bytes that fit in a new file before the
+   disk runs out of space, leaving the disk as it was. */
+static size_t free_space(void) {
+  size_t size = 0;
+  int fd, n;
+
+  if (!create("fill", 0) || (fd = open("fill")) < 2)
+    fail("create \"fill\" failed");
+  while ((n = write(fd, fill, sizeof fill)) > 0)
+    size += n;
+  close(fd);
+  if (!remove("fill"))
+    fail("remove \"fill\" failed");
+  sync();
+  return size;
+}
+
+void test_main(void) {
+  size_t before, after, i;
+  int a, b;
+
+  for (i = 0; i < FILE_SIZE; i++)
+    data[i] = data_a[i] = data_b[i] = 'a' + i % 26;
+  memset(data_a, 'A', 512);
+  memset(data_b + 1024, 'B', 512);
+
+  before = free_space();
+  CHECK(create("a", 0), "create \"a\"");
+  CHECK((a = open("a")) > 1, "open \"a\"");
+  CHECK(write(a, data, FILE_SIZE) == FILE_SIZE, "write \"a\"");
+  CHECK(create("b", 0), "create \"b\"");
+  CHECK((b = open("b")) > 1, "open \"b\"");
+  CHECK(clone_file(a, b), "clone \"a\" into \"b\"");
+
+  seek(a, 0);
+  CHECK(write(a, data_a, 512) == 512, "write \"a\" at offset 0");
+  seek(b, 1024);
+  CHECK(write(b, data_b + 1024, 512) == 512, "write \"b\" at offset 1024");
+  seek(a, 0);
+  check_file_handle(a, "a", data_a, FILE_SIZE);
+  seek(b, 0);
+  check_file_handle(b, "b", data_b, FILE_SIZE);
+
+  CHECK(remove("a"), "remove \"a\"");
+  CHECK(remove("b"), "remove \"b\"");
+  close(a);
+  close(b);
+  after = free_space();
+  if (after != before)
+    fail("%zu bytes free before clone, %zu after removing both files", before, after);
+  msg("no sectors leaked");
+}
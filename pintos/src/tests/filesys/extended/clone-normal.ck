@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(clone-normal) begin
+(clone-normal) create "a"
+(clone-normal) open "a"
+(clone-normal) write "a"
+(clone-normal) create "b"
+(clone-normal) open "b"
+(clone-normal) clone "a" into "b"
+(clone-normal) write "a" at offset 0
+(clone-normal) write "b" at offset 1024
+(clone-normal) verified contents of "a"
+(clone-normal) verified contents of "b"
+(clone-normal) remove "a"
+(clone-normal) remove "b"
+(clone-normal) no sectors leaked
+(clone-normal) end
+EOF
+pass;
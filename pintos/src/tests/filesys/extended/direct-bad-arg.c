@@ -0,0 +1,20 @@
+/* Passes an unknown command to fcntl(), which must fail and
+   leave the file's flags alone, then passes a bad fd, which must
+   terminate the process with -1 exit code. */
+
+#include <fcntl.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  int fd;
+
+  CHECK(create("f", 0), "create \"f\"");
+  CHECK((fd = open("f")) > 1, "open \"f\"");
+  CHECK(fcntl(fd, 99, O_DIRECT) == -1, "fcntl with unknown command (must fail)");
+  CHECK(fcntl(fd, F_GETFL, 0) == 0, "flags are still 0");
+
+  fcntl(0x20101234, F_SETFL, O_DIRECT);
+  fail("should not have survived fcntl()");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(direct-bad-arg) begin
+(direct-bad-arg) create "f"
+(direct-bad-arg) open "f"
+(direct-bad-arg) fcntl with unknown command (must fail)
+(direct-bad-arg) flags are still 0
+direct-bad-arg: exit(-1)
+EOF
+pass;
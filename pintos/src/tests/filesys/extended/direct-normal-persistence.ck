@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = join ('', map (chr (ord ('a') + $_ % 26), 0 .. 1599));
+check_archive ({"f" => ["\0" x 100 . $data]});
+pass;
@@ -0,0 +1,38 @@
+/* Turns on O_DIRECT with fcntl(), writes a range with an
+   unaligned head and tail through it, and checks that the data
+   reads back both directly and through a second, cached
+   handle. */
+
+#include <fcntl.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OFS 100
+#define SIZE 1600
+
+static char data[SIZE];
+static char expected[OFS + SIZE];
+
+void test_main(void) {
+  int fd, cached;
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    data[i] = expected[OFS + i] = 'a' + i % 26;
+
+  CHECK(create("f", 0), "create \"f\"");
+  CHECK((fd = open("f")) > 1, "open \"f\"");
+  CHECK(fcntl(fd, F_SETFL, O_DIRECT) == 0, "set O_DIRECT");
+  CHECK(fcntl(fd, F_GETFL, 0) == O_DIRECT, "get O_DIRECT");
+  seek(fd, OFS);
+  CHECK(write(fd, data, SIZE) == SIZE, "write %d bytes at offset %d", SIZE, OFS);
+
+  seek(fd, 0);
+  check_file_handle(fd, "f", expected, sizeof expected);
+  CHECK((cached = open("f")) > 1, "open \"f\" again");
+  CHECK(fcntl(cached, F_GETFL, 0) == 0, "second handle is not direct");
+  check_file_handle(cached, "f", expected, sizeof expected);
+  close(cached);
+  close(fd);
+}
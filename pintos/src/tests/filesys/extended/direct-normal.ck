@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(direct-normal) begin
+(direct-normal) create "f"
+(direct-normal) open "f"
+(direct-normal) set O_DIRECT
+(direct-normal) get O_DIRECT
+(direct-normal) write 1600 bytes at offset 100
+(direct-normal) verified contents of "f"
+(direct-normal) open "f" again
+(direct-normal) second handle is not direct
+(direct-normal) verified contents of "f"
+(direct-normal) end
+EOF
+pass;
@@ -0,0 +1,21 @@
+/* Calls fallocate() on a directory and with a zero length, which
+   must both fail and leave the file unchanged. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  int fd;
+
+  CHECK(mkdir("a"), "mkdir \"a\"");
+  CHECK((fd = open("a")) > 1, "open \"a\"");
+  CHECK(!fallocate(fd, 0, 512), "fallocate \"a\" (must fail)");
+  close(fd);
+
+  CHECK(create("f", 0), "create \"f\"");
+  CHECK((fd = open("f")) > 1, "open \"f\"");
+  CHECK(!fallocate(fd, 100, 0), "fallocate 0 bytes (must fail)");
+  CHECK(filesize(fd) == 0, "file size is still 0");
+  close(fd);
+}
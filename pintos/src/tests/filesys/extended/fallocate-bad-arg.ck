@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fallocate-bad-arg) begin
+(fallocate-bad-arg) mkdir "a"
+(fallocate-bad-arg) open "a"
+(fallocate-bad-arg) fallocate "a" (must fail)
+(fallocate-bad-arg) create "f"
+(fallocate-bad-arg) open "f"
+(fallocate-bad-arg) fallocate 0 bytes (must fail)
+(fallocate-bad-arg) file size is still 0
+(fallocate-bad-arg) end
+EOF
+pass;
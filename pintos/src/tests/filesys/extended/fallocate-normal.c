@@ -0,0 +1,28 @@
+/* Grows an empty file with fallocate(), checks that the new part
+   reads as zeros without moving the file position, then writes
+   into the middle of it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[5000];
+
+void test_main(void) {
+  int fd;
+
+  CHECK(create("f", 0), "create \"f\"");
+  CHECK((fd = open("f")) > 1, "open \"f\"");
+  CHECK(fallocate(fd, 0, sizeof buf), "fallocate %zu bytes", sizeof buf);
+  CHECK(filesize(fd) == sizeof buf, "file size is %zu", sizeof buf);
+  CHECK(tell(fd) == 0, "file position is still 0");
+  check_file_handle(fd, "f", buf, sizeof buf);
+
+  seek(fd, 1000);
+  CHECK(write(fd, "abcdefghij", 10) == 10, "write 10 bytes at offset 1000");
+  memcpy(buf + 1000, "abcdefghij", 10);
+  seek(fd, 0);
+  check_file_handle(fd, "f", buf, sizeof buf);
+  close(fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fallocate-normal) begin
+(fallocate-normal) create "f"
+(fallocate-normal) open "f"
+(fallocate-normal) fallocate 5000 bytes
+(fallocate-normal) file size is 5000
+(fallocate-normal) file position is still 0
+(fallocate-normal) verified contents of "f"
+(fallocate-normal) write 10 bytes at offset 1000
+(fallocate-normal) verified contents of "f"
+(fallocate-normal) end
+EOF
+pass;
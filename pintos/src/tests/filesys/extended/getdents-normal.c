@@ -0,0 +1,35 @@
+/* Lists a directory holding a file and a subdirectory with
+   getdents(), which must return each of them once, with the
+   right type and size, and then report the end. */
+
+#include <dirent.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  struct dirent entries[8];
+  bool found_x = false, found_y = false;
+  int fd, cnt, i;
+
+  CHECK(mkdir("a"), "mkdir \"a\"");
+  CHECK(create("a/x", 100), "create \"a/x\"");
+  CHECK(mkdir("a/y"), "mkdir \"a/y\"");
+  CHECK((fd = open("a")) > 1, "open \"a\"");
+
+  CHECK((cnt = getdents(fd, entries, 8)) == 2, "getdents \"a\"");
+  for (i = 0; i < cnt; i++) {
+    struct dirent* d = &entries[i];
+
+    if (!strcmp(d->d_name, "x") && d->d_type == DT_REG && d->d_size == 100)
+      found_x = true;
+    else if (!strcmp(d->d_name, "y") && d->d_type == DT_DIR)
+      found_y = true;
+    else
+      fail("unexpected entry \"%s\" of type %d", d->d_name, d->d_type);
+  }
+  CHECK(found_x && found_y, "found \"x\" and \"y\"");
+  CHECK(getdents(fd, entries, 8) == 0, "getdents at end of \"a\"");
+  close(fd);
+}
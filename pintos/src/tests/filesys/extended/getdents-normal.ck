@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(getdents-normal) begin
+(getdents-normal) mkdir "a"
+(getdents-normal) create "a/x"
+(getdents-normal) mkdir "a/y"
+(getdents-normal) open "a"
+(getdents-normal) getdents "a"
+(getdents-normal) found "x" and "y"
+(getdents-normal) getdents at end of "a"
+(getdents-normal) end
+EOF
+pass;
@@ -0,0 +1,114 @@
+/* Test program for lib/kernel/bitmap.c.
+
+   Checks bitmap_scan() and bitmap_contains() against a naive
+   bit-by-bit reference on random bitmaps, then times searches
+   for free bits in nearly full bitmaps, the case that the free
+   map and the page allocator hit once a disk or memory fills.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Number of bits in the bitmaps used for checking. */
+#define CHECK_BITS 300
+
+/* Number of bits in the bitmap used for timing, as many as a
+   free map for an 8 MB disk. */
+#define BENCH_BITS 16384
+
+/* Number of searches timed per benchmark. */
+#define BENCH_ITERS 2000
+
+static size_t naive_scan(const struct bitmap*, size_t start, size_t cnt, bool);
+static void check_random(void);
+static void bench_nearly_full(void);
+
+void test(void) {
+  check_random();
+  bench_nearly_full();
+}
+
+/* Reference implementation of bitmap_scan(). */
+static size_t naive_scan(const struct bitmap* b, size_t start, size_t cnt, bool value) {
+  size_t i, j;
+
+  for (i = start; i + cnt <= bitmap_size(b); i++) {
+    for (j = 0; j < cnt; j++)
+      if (bitmap_test(b, i + j) != value)
+        break;
+    if (j == cnt)
+      return i;
+  }
+  return BITMAP_ERROR;
+}
+
+/* Compares bitmap_scan() with naive_scan() on bitmaps of
+   varying density. */
+static void check_random(void) {
+  struct bitmap* b;
+  int density, round;
+
+  printf("checking bitmap_scan against reference...");
+  b = bitmap_create(CHECK_BITS);
+  ASSERT(b != NULL);
+  for (density = 0; density <= 16; density++)
+    for (round = 0; round < 8; round++) {
+      size_t i, start, cnt;
+
+      for (i = 0; i < CHECK_BITS; i++)
+        bitmap_set(b, i, random_ulong() % 16 < (unsigned)density);
+      for (start = 0; start < CHECK_BITS; start += 7)
+        for (cnt = 0; cnt <= 40; cnt += 3) {
+          ASSERT(bitmap_scan(b, start, cnt, false) == naive_scan(b, start, cnt, false));
+          ASSERT(bitmap_scan(b, start, cnt, true) == naive_scan(b, start, cnt, true));
+          if (start + cnt <= CHECK_BITS) {
+            ASSERT(bitmap_contains(b, start, cnt, true) ==
+                   (cnt > 0 && naive_scan(b, start, cnt, false) != start));
+          }
+        }
+    }
+  bitmap_destroy(b);
+  printf(" done\n");
+}
+
+/* Times single-bit and multi-bit searches for free bits in a
+   bitmap whose only free bits are near the end. */
+static void bench_nearly_full(void) {
+  struct bitmap* b;
+  int64_t start;
+  int i;
+
+  b = bitmap_create(BENCH_BITS);
+  ASSERT(b != NULL);
+  bitmap_set_all(b, true);
+  bitmap_set_multiple(b, BENCH_BITS - 64, 8, false);
+  bitmap_reset(b, BENCH_BITS - 200);
+
+  start = timer_ticks();
+  for (i = 0; i < BENCH_ITERS; i++)
+    ASSERT(bitmap_scan(b, 0, 1, false) == BENCH_BITS - 200);
+  printf("%d single-bit scans of %d-bit map: %lld ticks\n", BENCH_ITERS, BENCH_BITS,
+         timer_elapsed(start));
+
+  start = timer_ticks();
+  for (i = 0; i < BENCH_ITERS; i++)
+    ASSERT(bitmap_scan(b, 0, 8, false) == BENCH_BITS - 64);
+  printf("%d 8-bit run scans of %d-bit map: %lld ticks\n", BENCH_ITERS, BENCH_BITS,
+         timer_elapsed(start));
+
+  start = timer_ticks();
+  for (i = 0; i < BENCH_ITERS; i++)
+    ASSERT(bitmap_scan(b, 0, 16, false) == BITMAP_ERROR);
+  printf("%d failed 16-bit run scans of %d-bit map: %lld ticks\n", BENCH_ITERS, BENCH_BITS,
+         timer_elapsed(start));
+
+  bitmap_destroy(b);
+}
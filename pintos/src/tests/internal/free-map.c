@@ -0,0 +1,98 @@
+/* Test program for the inode tables in filesys/free-map.c.
+
+   Checks that inodes are packed INODES_PER_SECTOR to a sector,
+   starting with the free map and root directory inodes right
+   after the super block, that inodes sharing a sector keep their
+   own contents, and that formatting leaves sector ROOT_DIR_SECTOR
+   free for data.  Must run on a freshly formatted file system.
+
+   A disk formatted before inode tables, where the inode number is
+   the sector, is not covered: nothing here can format one.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "threads/test.h"
+
+/* Inodes that fit in one table sector. */
+#define PER_SECTOR (BLOCK_SECTOR_SIZE / INODE_DISK_SIZE)
+
+/* Inodes created by check_packing(). */
+#define PACK_CNT (4 * PER_SECTOR)
+
+static void check_layout(void);
+static void check_packing(void);
+static void check_sector_one(void);
+
+void test(void) {
+  check_layout();
+  check_packing();
+  check_sector_one();
+}
+
+/* Checks where the free map and root directory inodes are. */
+static void check_layout(void) {
+  size_t ofs;
+
+  printf("checking inode table layout...");
+  ASSERT(free_map_inode_sector(FREE_MAP_SECTOR, &ofs) == SUPER_SECTOR + 1);
+  ASSERT(ofs == 0);
+  ASSERT(free_map_inode_sector(ROOT_DIR_SECTOR, &ofs) == SUPER_SECTOR + 1);
+  ASSERT(ofs == INODE_DISK_SIZE);
+  printf(" done\n");
+}
+
+/* Creates PACK_CNT inodes of different lengths next to each
+   other, and checks that each reads back its own length and that
+   consecutive inode numbers share table sectors. */
+static void check_packing(void) {
+  block_sector_t inumbers[PACK_CNT];
+  size_t shared = 0;
+  int i;
+
+  printf("checking that packed inodes keep their contents...");
+  for (i = 0; i < PACK_CNT; i++) {
+    ASSERT(free_map_allocate_inode(SUPER_SECTOR + 1, &inumbers[i]));
+    ASSERT(inode_create(inumbers[i], i * 100, false));
+  }
+
+  for (i = 0; i < PACK_CNT; i++) {
+    struct inode* inode = inode_open(inumbers[i]);
+    size_t ofs, next_ofs;
+
+    ASSERT(inode != NULL);
+    ASSERT(inode_length(inode) == i * 100);
+    ASSERT(free_map_inode_sector(inumbers[i], &ofs) != 0);
+    ASSERT(ofs % INODE_DISK_SIZE == 0 && ofs < BLOCK_SECTOR_SIZE);
+    if (i + 1 < PACK_CNT && inumbers[i + 1] == inumbers[i] + 1 &&
+        free_map_inode_sector(inumbers[i + 1], &next_ofs) ==
+            free_map_inode_sector(inumbers[i], &ofs)) {
+      ASSERT(next_ofs == ofs + INODE_DISK_SIZE);
+      shared++;
+    }
+    inode_remove(inode);
+    inode_close(inode);
+  }
+  ASSERT(shared >= PACK_CNT - PACK_CNT / PER_SECTOR - 1);
+  inode_reclaim_wait();
+  printf(" done\n");
+}
+
+/* Checks that formatting left sector ROOT_DIR_SECTOR free, and
+   that sector 0, which means no block in a block map, is not. */
+static void check_sector_one(void) {
+  block_sector_t sector;
+
+  printf("checking that sector %d is free for data...", ROOT_DIR_SECTOR);
+  ASSERT(free_map_allocate_near(1, 0, &sector));
+  ASSERT(sector == ROOT_DIR_SECTOR);
+  free_map_release(sector, 1);
+  printf(" done\n");
+}
@@ -0,0 +1,109 @@
+/* Test program for filesys/journal.c.
+
+   Checks that a metadata write stays out of its home sector until
+   journal_sync() commits it, and that journal_open() replays a
+   commit that was cut short after its header reached the disk,
+   but not one whose journal copy is torn.  Must run on a freshly
+   formatted file system with nothing else using it.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "threads/test.h"
+
+static void check_sync(void);
+static void check_replay(bool torn);
+
+void test(void) {
+  check_sync();
+  check_replay(false);
+  check_replay(true);
+}
+
+/* Fills the sector-sized BUFFER with BYTE. */
+static void fill(uint8_t* buffer, uint8_t byte) { memset(buffer, byte, BLOCK_SECTOR_SIZE); }
+
+/* Returns true if the home copy of SECTOR is all BYTE. */
+static bool home_is(block_sector_t sector, uint8_t byte) {
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];
+  int i;
+
+  block_read_raw(fs_device, sector, buffer);
+  for (i = 0; i < BLOCK_SECTOR_SIZE; i++)
+    if (buffer[i] != byte)
+      return false;
+  return true;
+}
+
+/* Writes a metadata sector and checks that it reaches its home
+   location only through a commit. */
+static void check_sync(void) {
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];
+  block_sector_t sector;
+
+  printf("checking that journal_sync commits metadata...");
+  ASSERT(journal_enabled());
+  ASSERT(free_map_allocate(1, &sector));
+  fill(buffer, 0);
+  block_write_raw(fs_device, sector, buffer);
+
+  fill(buffer, 0xa5);
+  block_write_meta(fs_device, sector, buffer, 0, BLOCK_SECTOR_SIZE);
+  ASSERT(home_is(sector, 0));
+  journal_sync();
+  ASSERT(home_is(sector, 0xa5));
+
+  cache_discard(&filesys_cache, sector);
+  free_map_release(sector, 1);
+  printf(" done\n");
+}
+
+/* Leaves the journal as a crash right after a commit's header
+   write would, with one sector to replay, then reopens it.  If
+   TORN, the journal copy of the sector does not match the
+   header's checksum, as if the crash came while it was written. */
+static void check_replay(bool torn) {
+  static uint8_t buffer[BLOCK_SECTOR_SIZE];
+  struct journal_header* h = (struct journal_header*)buffer;
+  block_sector_t start, sector;
+  unsigned checksum;
+
+  printf("checking journal replay of a %s commit...", torn ? "torn" : "complete");
+  journal_sync();
+  start = journal_get_start();
+  ASSERT(start != 0);
+  ASSERT(free_map_allocate(1, &sector));
+  fill(buffer, 0);
+  block_write_raw(fs_device, sector, buffer);
+
+  fill(buffer, 0x3c);
+  checksum = hash_bytes(buffer, BLOCK_SECTOR_SIZE);
+  if (torn)
+    buffer[BLOCK_SECTOR_SIZE / 2] ^= 1;
+  block_write_raw(fs_device, start + 1, buffer);
+
+  block_read_raw(fs_device, start, buffer);
+  ASSERT(h->magic == JOURNAL_MAGIC && h->cnt == 0);
+  h->seq++;
+  h->cnt = 1;
+  h->checksum = checksum;
+  h->home[0] = sector;
+  block_write_raw(fs_device, start, buffer);
+
+  journal_open(start);
+  ASSERT(home_is(sector, torn ? 0 : 0x3c));
+  block_read_raw(fs_device, start, buffer);
+  ASSERT(h->cnt == 0);
+
+  free_map_release(sector, 1);
+  printf(" done\n");
+}
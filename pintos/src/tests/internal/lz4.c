@@ -0,0 +1,195 @@
+/* Test program for lib/kernel/lz4.c.
+
+   Checks that lz4_compress() and lz4_decompress() round-trip
+   random, repetitive and text-like blocks, and that corrupt
+   blocks are rejected without overrunning the output.  Then
+   measures what compressing 8-sector clusters of text-like data,
+   as filesys/inode.c does for compressed files, is worth: the
+   sectors saved per cluster, and the time to read a cluster's
+   sectors uncached from the file system device, raw versus
+   compressed plus the time to decompress it.  Finally times
+   writing and reading back a file of such clusters through
+   filesys/inode.c, plain and compressed.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <lz4.h>
+#include <debug.h>
+#include <random.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/test.h"
+
+/* Size of the blocks compressed: one cluster. */
+#define CLUSTER_SIZE (8 * BLOCK_SECTOR_SIZE)
+
+/* Number of random blocks checked. */
+#define CHECK_ITERS 300
+
+/* Number of clusters timed per benchmark. */
+#define BENCH_ITERS 200
+
+/* Clusters in each file timed through the file system, several
+   times as many sectors as the buffer cache holds. */
+#define BENCH_FILE_CLUSTERS 64
+
+/* Buffers, too big for the kernel stack. */
+struct buffers {
+  uint8_t in[CLUSTER_SIZE];
+  uint8_t packed[2 * CLUSTER_SIZE];
+  uint8_t out[CLUSTER_SIZE];
+  uint16_t table[LZ4_TABLE_SIZE];
+};
+
+static void fill_text(uint8_t*, size_t);
+static void check_round_trip(struct buffers*);
+static void bench_clusters(struct buffers*);
+static void bench_file(struct buffers*, bool compressed);
+
+void test(void) {
+  struct buffers* b = malloc(sizeof *b);
+
+  ASSERT(b != NULL);
+  check_round_trip(b);
+  bench_clusters(b);
+  bench_file(b, false);
+  bench_file(b, true);
+  free(b);
+}
+
+/* Fills the SIZE bytes at P with words picked at random from a
+   small vocabulary, which compresses about as well as English. */
+static void fill_text(uint8_t* p, size_t size) {
+  static const char* words[] = {"the ",  "file ",   "system ", "sector ", "cache ",
+                                "of ",   "inode ",  "a ",      "block ",  "data ",
+                                "and ",  "to ",     "disk ",   "read ",   "write ",
+                                "is\n",  "free ",   "map ",    "in ",     "directory "};
+  size_t i = 0;
+
+  while (i < size) {
+    const char* w = words[random_ulong() % (sizeof words / sizeof *words)];
+    while (*w != '\0' && i < size)
+      p[i++] = *w++;
+  }
+}
+
+/* Compresses and decompresses blocks of every kind and size, and
+   decompresses damaged copies of them. */
+static void check_round_trip(struct buffers* b) {
+  int iter;
+
+  printf("checking lz4 round trips...");
+  for (iter = 0; iter < CHECK_ITERS; iter++) {
+    size_t len = random_ulong() % (CLUSTER_SIZE + 1);
+    size_t packed, i;
+
+    if (iter % 3 == 0)
+      for (i = 0; i < len; i++)
+        b->in[i] = random_ulong();
+    else if (iter % 3 == 1)
+      for (i = 0; i < len; i++)
+        b->in[i] = i / 37 % 5;
+    else
+      fill_text(b->in, len);
+
+    packed = lz4_compress(b->in, len, b->packed, sizeof b->packed, b->table);
+    ASSERT(packed > 0);
+    ASSERT(lz4_decompress(b->packed, packed, b->out, CLUSTER_SIZE) == len);
+    ASSERT(!memcmp(b->in, b->out, len));
+
+    /* A block that does not fit is refused. */
+    if (packed > 1) {
+      ASSERT(lz4_compress(b->in, len, b->packed, packed - 1, b->table) == 0);
+    }
+
+    /* Damage is either detected or harmless. */
+    for (i = 0; i < 16; i++) {
+      b->packed[random_ulong() % packed] ^= 1 << random_ulong() % 8;
+      size_t n = lz4_decompress(b->packed, packed, b->out, CLUSTER_SIZE);
+      ASSERT(n == LZ4_ERROR || n <= CLUSTER_SIZE);
+    }
+  }
+  printf(" done\n");
+}
+
+/* Times reading clusters of text from the file system device
+   uncached, raw and compressed. */
+static void bench_clusters(struct buffers* b) {
+  block_sector_t base = block_size(fs_device) - 8;
+  size_t packed, sectors, i;
+  int64_t start, raw, comp, decomp;
+  int iter;
+
+  fill_text(b->in, CLUSTER_SIZE);
+  packed = lz4_compress(b->in, CLUSTER_SIZE, b->packed, sizeof b->packed, b->table);
+  ASSERT(packed > 0);
+  sectors = DIV_ROUND_UP(packed + 2, BLOCK_SECTOR_SIZE);
+  printf("%d-byte text cluster compresses to %zu bytes: %zu of 8 sectors\n", CLUSTER_SIZE,
+         packed, sectors);
+
+  start = timer_ticks();
+  for (iter = 0; iter < BENCH_ITERS; iter++)
+    for (i = 0; i < 8; i++)
+      block_read_raw(fs_device, base + i, b->out + i * BLOCK_SECTOR_SIZE);
+  raw = timer_elapsed(start);
+
+  start = timer_ticks();
+  for (iter = 0; iter < BENCH_ITERS; iter++)
+    for (i = 0; i < sectors; i++)
+      block_read_raw(fs_device, base + i, b->out + i * BLOCK_SECTOR_SIZE);
+  comp = timer_elapsed(start);
+
+  start = timer_ticks();
+  for (iter = 0; iter < BENCH_ITERS; iter++)
+    ASSERT(lz4_decompress(b->packed, packed, b->out, CLUSTER_SIZE) == CLUSTER_SIZE);
+  decomp = timer_elapsed(start);
+
+  printf("%d raw cluster reads: %lld ticks\n", BENCH_ITERS, raw);
+  printf("%d compressed cluster reads: %lld ticks reading + %lld ticks decompressing\n",
+         BENCH_ITERS, comp, decomp);
+}
+
+/* Times writing a file of BENCH_FILE_CLUSTERS text clusters, a
+   cluster per write, committing it, and reading it back, through
+   an inode that stores its data COMPRESSED or not. */
+static void bench_file(struct buffers* b, bool compressed) {
+  const char* name = compressed ? "lz4-packed" : "lz4-plain";
+  struct file* file;
+  int64_t start, write, read;
+  int i;
+
+  ASSERT(filesys_create(name, 0));
+  file = filesys_open(name);
+  ASSERT(file != NULL);
+  ASSERT(inode_set_compressed(file_get_inode(file), compressed));
+  fill_text(b->in, CLUSTER_SIZE);
+
+  start = timer_ticks();
+  for (i = 0; i < BENCH_FILE_CLUSTERS; i++)
+    ASSERT(file_write_at(file, b->in, CLUSTER_SIZE, i * CLUSTER_SIZE) == CLUSTER_SIZE);
+  journal_sync();
+  write = timer_elapsed(start);
+
+  start = timer_ticks();
+  for (i = 0; i < BENCH_FILE_CLUSTERS; i++) {
+    ASSERT(file_read_at(file, b->out, CLUSTER_SIZE, i * CLUSTER_SIZE) == CLUSTER_SIZE);
+    ASSERT(!memcmp(b->in, b->out, CLUSTER_SIZE));
+  }
+  read = timer_elapsed(start);
+
+  file_close(file);
+  ASSERT(filesys_remove(name));
+  printf("%s file of %d clusters: %lld ticks writing, %lld ticks reading\n",
+         compressed ? "compressed" : "plain", BENCH_FILE_CLUSTERS, write, read);
+}
@@ -0,0 +1,24 @@
+/* Tries to map a file at a null, a misaligned and an already
+   mapped address, and over the program's own code.  Each must
+   fail without touching the process. */
+
+#include <round.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char*)0x10000000)
+
+void test_main(void) {
+  void* code = (void*)ROUND_DOWN((uintptr_t)test_main, 4096);
+  int fd[2];
+
+  CHECK((fd[0] = open("sample.txt")) > 1, "open \"sample.txt\" once");
+  CHECK(mmap(fd[0], NULL) == MAP_FAILED, "try to mmap at null address");
+  CHECK(mmap(fd[0], ACTUAL + 0x1234) == MAP_FAILED, "try to mmap at misaligned address");
+  CHECK(mmap(fd[0], code) == MAP_FAILED, "try to mmap over code segment");
+  CHECK(mmap(fd[0], ACTUAL) != MAP_FAILED, "mmap \"sample.txt\"");
+  CHECK((fd[1] = open("sample.txt")) > 1 && fd[0] != fd[1], "open \"sample.txt\" again");
+  CHECK(mmap(fd[1], ACTUAL) == MAP_FAILED, "try to mmap \"sample.txt\" over itself");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mmap-bad-addr) begin
+(mmap-bad-addr) open "sample.txt" once
+(mmap-bad-addr) try to mmap at null address
+(mmap-bad-addr) try to mmap at misaligned address
+(mmap-bad-addr) try to mmap over code segment
+(mmap-bad-addr) mmap "sample.txt"
+(mmap-bad-addr) open "sample.txt" again
+(mmap-bad-addr) try to mmap "sample.txt" over itself
+(mmap-bad-addr) end
+mmap-bad-addr: exit(0)
+EOF
+pass;
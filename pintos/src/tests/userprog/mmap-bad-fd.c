@@ -0,0 +1,17 @@
+/* Tries to map an invalid fd and a closed one, which must fail
+   without terminating the process. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void*)0x10000000)
+
+void test_main(void) {
+  int handle;
+
+  CHECK(mmap(0x5678, ACTUAL) == MAP_FAILED, "try to mmap invalid fd");
+  CHECK((handle = open("sample.txt")) > 1, "open \"sample.txt\"");
+  close(handle);
+  CHECK(mmap(handle, ACTUAL) == MAP_FAILED, "try to mmap closed fd");
+}
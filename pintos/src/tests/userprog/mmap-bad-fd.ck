@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mmap-bad-fd) begin
+(mmap-bad-fd) try to mmap invalid fd
+(mmap-bad-fd) open "sample.txt"
+(mmap-bad-fd) try to mmap closed fd
+(mmap-bad-fd) end
+mmap-bad-fd: exit(0)
+EOF
+pass;
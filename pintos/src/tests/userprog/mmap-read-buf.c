@@ -0,0 +1,34 @@
+/* Passes a mapped page that has not been touched yet as the
+   buffer to read(), so that the kernel itself brings the page in,
+   then unmaps it and checks that the data reached the mapped
+   file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char*)0x10000000)
+
+static char expected[4096];
+
+void test_main(void) {
+  size_t size = sizeof sample - 1;
+  int handle, map_handle;
+  mapid_t map;
+
+  memcpy(expected, sample, size);
+  CHECK(create("buf.txt", sizeof expected), "create \"buf.txt\"");
+  CHECK((map_handle = open("buf.txt")) > 1, "open \"buf.txt\"");
+  CHECK((map = mmap(map_handle, ACTUAL)) != MAP_FAILED, "mmap \"buf.txt\"");
+  CHECK((handle = open("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK(read(handle, ACTUAL, size) == (int)size, "read \"sample.txt\" into mapping");
+  if (memcmp(ACTUAL, sample, size))
+    fail("read into mmap'd page reported bad data");
+  munmap(map);
+  close(map_handle);
+  close(handle);
+
+  check_file("buf.txt", expected, sizeof expected);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mmap-read-buf) begin
+(mmap-read-buf) create "buf.txt"
+(mmap-read-buf) open "buf.txt"
+(mmap-read-buf) mmap "buf.txt"
+(mmap-read-buf) open "sample.txt"
+(mmap-read-buf) read "sample.txt" into mapping
+(mmap-read-buf) open "buf.txt" for verification
+(mmap-read-buf) verified contents of "buf.txt"
+(mmap-read-buf) close "buf.txt"
+(mmap-read-buf) end
+mmap-read-buf: exit(0)
+EOF
+pass;
@@ -0,0 +1,26 @@
+/* Maps a file and checks that reading the mapping gives the
+   file's data, followed by zeros to the end of the page. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char*)0x10000000)
+
+void test_main(void) {
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  CHECK((handle = open("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK((map = mmap(handle, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  if (memcmp(ACTUAL, sample, sizeof sample - 1))
+    fail("read of mmap'd file reported bad data");
+  for (i = sizeof sample - 1; i < 4096; i++)
+    if (ACTUAL[i] != 0)
+      fail("byte %zu of mmap'd region has value %02hhx (should be 0)", i, ACTUAL[i]);
+  munmap(map);
+  close(handle);
+}
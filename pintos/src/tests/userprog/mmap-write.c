@@ -0,0 +1,25 @@
+/* Writes a file through a mapping, unmaps it and closes the
+   file, then checks that the data reached the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void*)0x10000000)
+
+void test_main(void) {
+  size_t size = sizeof sample - 1;
+  int handle;
+  mapid_t map;
+
+  CHECK(create("test.txt", size), "create \"test.txt\"");
+  CHECK((handle = open("test.txt")) > 1, "open \"test.txt\"");
+  CHECK((map = mmap(handle, ACTUAL)) != MAP_FAILED, "mmap \"test.txt\"");
+  memcpy(ACTUAL, sample, size);
+  munmap(map);
+  close(handle);
+
+  check_file("test.txt", sample, size);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(mmap-write) begin
+(mmap-write) create "test.txt"
+(mmap-write) open "test.txt"
+(mmap-write) mmap "test.txt"
+(mmap-write) open "test.txt" for verification
+(mmap-write) verified contents of "test.txt"
+(mmap-write) close "test.txt"
+(mmap-write) end
+mmap-write: exit(0)
+EOF
+pass;
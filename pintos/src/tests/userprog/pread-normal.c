@@ -0,0 +1,20 @@
+/* Reads part of a file with pread() and checks that the data is
+   right and that the file position did not move. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  char buf[32];
+  int handle;
+
+  CHECK((handle = open("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK(pread(handle, buf, sizeof buf, 20) == (int)sizeof buf, "pread 32 bytes at offset 20");
+  if (memcmp(buf, sample + 20, sizeof buf))
+    fail("pread returned bad data");
+  CHECK(tell(handle) == 0, "file position is still 0");
+  CHECK(pread(handle, buf, sizeof buf, sizeof sample) == 0, "pread past end of file");
+}
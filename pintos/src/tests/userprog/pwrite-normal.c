@@ -0,0 +1,24 @@
+/* Writes a file with pwrite(), out of order, and checks that the
+   file position did not move and that the file reads back
+   right. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  size_t size = sizeof sample - 1;
+  size_t half = size / 2;
+  int handle;
+
+  CHECK(create("test.txt", 0), "create \"test.txt\"");
+  CHECK((handle = open("test.txt")) > 1, "open \"test.txt\"");
+  CHECK(pwrite(handle, sample + half, size - half, half) == (int)(size - half),
+        "pwrite second half");
+  CHECK(pwrite(handle, sample, half, 0) == (int)half, "pwrite first half");
+  CHECK(tell(handle) == 0, "file position is still 0");
+  close(handle);
+
+  check_file("test.txt", sample, size);
+}
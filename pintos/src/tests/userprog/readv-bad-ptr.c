@@ -0,0 +1,23 @@
+/* Passes an invalid buffer pointer, after a valid one, to the
+   readv system call.  The process must be terminated with -1
+   exit code. */
+
+#include <syscall.h>
+#include <uio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  char buf[10];
+  struct iovec iov[2];
+  int handle;
+
+  iov[0].iov_base = buf;
+  iov[0].iov_len = sizeof buf;
+  iov[1].iov_base = (char*)0xc0100000;
+  iov[1].iov_len = 123;
+
+  CHECK((handle = open("sample.txt")) > 1, "open \"sample.txt\"");
+  readv(handle, iov, 2);
+  fail("should not have survived readv()");
+}
@@ -0,0 +1,29 @@
+/* Reads a file into three buffers, one of them empty, with a
+   single readv() call. */
+
+#include <string.h>
+#include <syscall.h>
+#include <uio.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  char head[10], tail[sizeof sample];
+  struct iovec iov[3];
+  size_t size = sizeof sample - 1;
+  int handle;
+
+  iov[0].iov_base = head;
+  iov[0].iov_len = sizeof head;
+  iov[1].iov_base = NULL;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = tail;
+  iov[2].iov_len = sizeof tail;
+
+  CHECK((handle = open("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK(readv(handle, iov, 3) == (int)size, "readv \"sample.txt\"");
+  if (memcmp(head, sample, sizeof head) || memcmp(tail, sample + sizeof head, size - sizeof head))
+    fail("readv returned bad data");
+  CHECK(tell(handle) == size, "file position is at end of file");
+}
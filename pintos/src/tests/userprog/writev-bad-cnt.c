@@ -0,0 +1,26 @@
+/* Passes more buffers than IOV_MAX, and a negative count, to the
+   writev system call, which must fail without writing. */
+
+#include <syscall.h>
+#include <uio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct iovec iov[IOV_MAX + 1];
+
+void test_main(void) {
+  static char buf[] = "x";
+  int handle;
+  int i;
+
+  for (i = 0; i <= IOV_MAX; i++) {
+    iov[i].iov_base = buf;
+    iov[i].iov_len = 1;
+  }
+
+  CHECK(create("test.txt", 0), "create \"test.txt\"");
+  CHECK((handle = open("test.txt")) > 1, "open \"test.txt\"");
+  CHECK(writev(handle, iov, IOV_MAX + 1) == -1, "writev %d buffers", IOV_MAX + 1);
+  CHECK(writev(handle, iov, -1) == -1, "writev -1 buffers");
+  CHECK(filesize(handle) == 0, "file is still empty");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(writev-bad-cnt) begin
+(writev-bad-cnt) create "test.txt"
+(writev-bad-cnt) open "test.txt"
+(writev-bad-cnt) writev 33 buffers
+(writev-bad-cnt) writev -1 buffers
+(writev-bad-cnt) file is still empty
+(writev-bad-cnt) end
+writev-bad-cnt: exit(0)
+EOF
+pass;
@@ -0,0 +1,28 @@
+/* Writes a file from three buffers, one of them empty, with a
+   single writev() call, and checks that it reads back right. */
+
+#include <syscall.h>
+#include <uio.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  size_t size = sizeof sample - 1;
+  struct iovec iov[3];
+  int handle;
+
+  iov[0].iov_base = sample;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = NULL;
+  iov[1].iov_len = 0;
+  iov[2].iov_base = sample + 10;
+  iov[2].iov_len = size - 10;
+
+  CHECK(create("test.txt", 0), "create \"test.txt\"");
+  CHECK((handle = open("test.txt")) > 1, "open \"test.txt\"");
+  CHECK(writev(handle, iov, 3) == (int)size, "writev \"test.txt\"");
+  close(handle);
+
+  check_file("test.txt", sample, size);
+}
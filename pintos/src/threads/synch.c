@@ -374,3 +374,88 @@ void cond_broadcast(struct condition* cond, struct lock* lock) {
   while (!list_empty(&cond->waiters))
     cond_signal(cond, lock);
 }
+
+/* Initializes readers-writer lock RW.  Like a lock, a
+   readers-writer lock may sleep and so must not be used within
+   an interrupt handler.  Readers may not recursively re-acquire
+   RW: a writer that started waiting in between would deadlock
+   both of them. */
+void rw_lock_init(struct rw_lock* rw) {
+  ASSERT(rw != NULL);
+
+  lock_init(&rw->lock);
+  cond_init(&rw->readers_ok);
+  cond_init(&rw->writer_ok);
+  rw->readers = 0;
+  rw->waiting_writers = 0;
+  rw->writer = false;
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it. */
+void rw_lock_acquire_read(struct rw_lock* rw) {
+  ASSERT(rw != NULL);
+
+  lock_acquire(&rw->lock);
+  while (rw->writer || rw->waiting_writers > 0)
+    cond_wait(&rw->readers_ok, &rw->lock);
+  rw->readers++;
+  lock_release(&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for reading. */
+void rw_lock_release_read(struct rw_lock* rw) {
+  ASSERT(rw != NULL);
+
+  lock_acquire(&rw->lock);
+  ASSERT(rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal(&rw->writer_ok, &rw->lock);
+  lock_release(&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or writer
+   holds it. */
+void rw_lock_acquire_write(struct rw_lock* rw) {
+  ASSERT(rw != NULL);
+
+  lock_acquire(&rw->lock);
+  rw->waiting_writers++;
+  while (rw->writer || rw->readers > 0)
+    cond_wait(&rw->writer_ok, &rw->lock);
+  rw->waiting_writers--;
+  rw->writer = true;
+  lock_release(&rw->lock);
+}
+
+/* Tries to acquire RW for writing and returns true if
+   successful or false on failure.  Fails without sleeping if a
+   reader or writer holds it. */
+bool rw_lock_try_acquire_write(struct rw_lock* rw) {
+  bool success;
+
+  ASSERT(rw != NULL);
+
+  lock_acquire(&rw->lock);
+  success = !rw->writer && rw->readers == 0;
+  if (success)
+    rw->writer = true;
+  lock_release(&rw->lock);
+  return success;
+}
+
+/* Releases RW, which the current thread must hold for writing.
+   Hands the lock to the next writer if there is one, otherwise
+   lets in all waiting readers. */
+void rw_lock_release_write(struct rw_lock* rw) {
+  ASSERT(rw != NULL);
+
+  lock_acquire(&rw->lock);
+  ASSERT(rw->writer);
+  rw->writer = false;
+  if (rw->waiting_writers > 0)
+    cond_signal(&rw->writer_ok, &rw->lock);
+  else
+    cond_broadcast(&rw->readers_ok, &rw->lock);
+  lock_release(&rw->lock);
+}
@@ -39,6 +39,25 @@ void cond_wait(struct condition*, struct lock*);
 void cond_signal(struct condition*, struct lock*);
 void cond_broadcast(struct condition*, struct lock*);
 
+/* Readers-writer lock.  Any number of readers or a single writer
+   may hold it at once.  Waiting writers keep new readers out, so
+   a steady stream of readers cannot starve a writer. */
+struct rw_lock {
+  struct lock lock;            /* Protects the fields below. */
+  struct condition readers_ok; /* Signaled when readers may enter. */
+  struct condition writer_ok;  /* Signaled when a writer may enter. */
+  int readers;                 /* Number of readers holding the lock. */
+  int waiting_writers;         /* Number of writers waiting to enter. */
+  bool writer;                 /* True while a writer holds the lock. */
+};
+
+void rw_lock_init(struct rw_lock*);
+void rw_lock_acquire_read(struct rw_lock*);
+void rw_lock_release_read(struct rw_lock*);
+void rw_lock_acquire_write(struct rw_lock*);
+bool rw_lock_try_acquire_write(struct rw_lock*);
+void rw_lock_release_write(struct rw_lock*);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -237,7 +237,6 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
   sf->eip = switch_entry;
   sf->ebp = 0;
 
-  t->file_allocd = 2;
   t->parent_process = thread_current();
   struct child_thread* cht = malloc(sizeof(struct child_thread));
 
@@ -376,7 +375,6 @@ void thread_exit(void) {
 
   struct thread* t = thread_current();
   struct child_thread* cht = NULL;
-  struct file_descriptor* fd = NULL;
   struct list_elem* e;
   intr_disable();
 
@@ -587,13 +585,13 @@ static void init_thread(struct thread* t, const char* name, int priority) {
   t->priority = t->priority_original = priority;
 
   list_init(&t->child_lst);
-  list_init(&t->files_lst);
+  list_init(&t->mappings);
+  t->mapid_next = 0;
   list_init(&t->donators_lst);
   t->parent_process = NULL;
   // list t->child_lst
 
   t->magic = THREAD_MAGIC;
-  t->current_working_dir = ROOT_DIR_SECTOR;
   old_level = intr_disable();
   list_push_back(&all_list, &t->allelem);
   intr_set_level(old_level);
@@ -678,14 +676,6 @@ void thread_schedule_tail(struct thread* prev) {
       struct list_elem* e = list_pop_front(&prev->child_lst);
       free(list_entry(e, struct child_thread, elem));
     }
-
-    while (!list_empty(&prev->files_lst)) {
-      struct list_elem* e = list_pop_front(&prev->files_lst);
-      struct file_descriptor* fd = list_entry(e, struct file_descriptor, elem);
-      if (!fd->closed)
-        file_close(fd->fp);
-      free(fd);
-    }
 #endif
 
     palloc_free_page(prev);
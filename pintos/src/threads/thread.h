@@ -27,6 +27,7 @@ typedef int tid_t;
 #define PRI_MAX 63     /* Highest priority. */
 
 struct child_thread;
+struct dir;
 
 /* A kernel thread or user process.
 
@@ -105,8 +106,12 @@ struct thread {
   struct thread* parent_process;
   struct list child_lst;
 
-  int file_allocd;
-  struct list files_lst;
+  struct file** files; /* Open files indexed by fd, null where free. */
+  int file_cnt;        /* Number of slots in FILES. */
+  int file_hint;       /* No free slot of FILES lies below this one. */
+
+  struct list mappings; /* Memory-mapped files, owned by userprog/mmap.c. */
+  int mapid_next;       /* Identifier for the next mapping. */
 
   struct list_elem wait; /* List element. */
   int sleep_till;
@@ -119,7 +124,8 @@ struct thread {
   struct lock* waiting_lock; // set non zero if waiting for a lock and blocked because of that
 
   struct file* tfp;
-  block_sector_t current_working_dir; //
+  struct dir* cwd; /* Working directory, or null for the root. */
+  int journal_depth; /* Holds on the journal barrier, owned by filesys/journal.c. */
 
   /* Owned by thread.c. */
   unsigned magic; /* Detects stack overflow. */
@@ -136,13 +142,6 @@ struct child_thread {
   struct semaphore load_sema;
 };
 
-struct file_descriptor {
-  int fd;
-  struct file* fp;
-  struct list_elem elem;
-  bool closed;
-};
-
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
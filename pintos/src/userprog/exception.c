@@ -2,13 +2,19 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/mmap.h"
+#include "userprog/syscall.h"
+#include "userprog/uaccess.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
 static void kill(struct intr_frame*);
+static void debug(struct intr_frame*);
 static void page_fault(struct intr_frame*);
 
 /* Registers handlers for interrupts that can be caused by user
@@ -40,7 +46,7 @@ void exception_init(void) {
      caused indirectly, e.g. #DE can be caused by dividing by
      0.  */
   intr_register_int(0, 0, INTR_ON, kill, "#DE Divide Error");
-  intr_register_int(1, 0, INTR_ON, kill, "#DB Debug Exception");
+  intr_register_int(1, 0, INTR_ON, debug, "#DB Debug Exception");
   intr_register_int(6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
   intr_register_int(7, 0, INTR_ON, kill, "#NM Device Not Available Exception");
   intr_register_int(11, 0, INTR_ON, kill, "#NP Segment Not Present");
@@ -99,6 +105,21 @@ static void kill(struct intr_frame* f) {
   }
 }
 
+/* Debug exception handler.  SYSENTER leaves TF as the user set
+   it, so a user program that single-steps through SYSENTER traps
+   at syscall_sysenter, in the kernel, on the SYSENTER entry
+   stack.  That is not a kernel bug: clear TF, which
+   syscall_sysenter would clear anyway, and carry on.  This runs
+   on the entry stack with interrupts off, so it must not look at
+   the current thread. */
+static void debug(struct intr_frame* f) {
+  if (f->cs == SEL_KCSEG && f->eip == syscall_sysenter) {
+    f->eflags &= ~FLAG_TF;
+    return;
+  }
+  kill(f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -137,9 +158,19 @@ static void page_fault(struct intr_frame* f) {
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+  /* Pages of memory-mapped files are read in on first access by
+     the process itself, or by the kernel through
+     userprog/uaccess.c, which is the only way the kernel touches
+     user memory.  Reading the file from any other kernel fault
+     could deadlock on a lock the kernel already holds. */
+  if (not_present && (user || uaccess_faulted(f)) && mmap_load(fault_addr))
+    return;
+
+  /* The kernel's own accesses to user memory through
+     userprog/uaccess.c fail softly instead. */
+  if (!user && is_user_vaddr(fault_addr) && uaccess_fixup(f))
+    return;
+
   printf("Page fault at %p: %s error %s page in %s context.\n", fault_addr,
          not_present ? "not present" : "rights violation", write ? "writing" : "reading",
          user ? "user" : "kernel");
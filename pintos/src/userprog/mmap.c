@@ -0,0 +1,150 @@
+#include "userprog/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* A file mapped into a process's address space.  Pages are read
+   in from the file when first touched, through mmap_load(), and
+   written back if dirty when the mapping goes away. */
+struct mapping {
+  int id;                /* Mapping identifier. */
+  struct file* file;     /* Own handle, so closing the fd leaves the mapping. */
+  uint8_t* addr;         /* First mapped page. */
+  off_t length;          /* Bytes of the file that are mapped. */
+  struct list_elem elem; /* Element in the owning thread's mappings. */
+};
+
+/* Returns the number of pages M spans. */
+static size_t page_cnt(const struct mapping* m) { return DIV_ROUND_UP(m->length, PGSIZE); }
+
+/* Returns the current process's mapping that contains user
+   address ADDR, or a null pointer if there is none. */
+static struct mapping* find_mapping(const void* addr) {
+  struct thread* t = thread_current();
+  struct list_elem* e;
+
+  for (e = list_begin(&t->mappings); e != list_end(&t->mappings); e = list_next(e)) {
+    struct mapping* m = list_entry(e, struct mapping, elem);
+    if ((const uint8_t*)addr >= m->addr && (const uint8_t*)addr < m->addr + page_cnt(m) * PGSIZE)
+      return m;
+  }
+  return NULL;
+}
+
+/* Maps FILE into the current process's address space starting at
+   page-aligned address ADDR.  Nothing is read until the pages are
+   touched.  Returns a mapping identifier, or -1 if FILE is empty
+   or a directory, ADDR is not suitable, or part of the range is
+   already in use. */
+int mmap_map(struct file* file, void* addr) {
+  struct thread* t = thread_current();
+  struct mapping* m;
+  off_t length = file_length(file);
+  size_t i;
+
+  if (addr == NULL || pg_ofs(addr) != 0 || length <= 0 || inode_is_dir(file_get_inode(file)))
+    return -1;
+  if ((uint8_t*)addr + ROUND_UP(length, PGSIZE) > (uint8_t*)PHYS_BASE ||
+      (uint8_t*)addr + ROUND_UP(length, PGSIZE) < (uint8_t*)addr)
+    return -1;
+  for (i = 0; i < (size_t)DIV_ROUND_UP(length, PGSIZE); i++) {
+    uint8_t* page = (uint8_t*)addr + i * PGSIZE;
+    if (pagedir_get_page(t->pagedir, page) != NULL || find_mapping(page) != NULL)
+      return -1;
+  }
+
+  m = malloc(sizeof *m);
+  if (m == NULL)
+    return -1;
+  m->file = file_reopen(file, file->dir_inode_sector);
+  if (m->file == NULL) {
+    free(m);
+    return -1;
+  }
+  m->id = t->mapid_next++;
+  m->addr = addr;
+  m->length = length;
+  list_push_back(&t->mappings, &m->elem);
+  return m->id;
+}
+
+/* Writes back M's dirty pages, frees its pages and removes it. */
+static void unmap(struct mapping* m) {
+  struct thread* t = thread_current();
+  size_t i;
+
+  for (i = 0; i < page_cnt(m); i++) {
+    uint8_t* page = m->addr + i * PGSIZE;
+    void* kpage = pagedir_get_page(t->pagedir, page);
+    off_t ofs = i * PGSIZE;
+
+    if (kpage == NULL)
+      continue;
+    if (pagedir_is_dirty(t->pagedir, page))
+      file_write_at(m->file, kpage, m->length - ofs < PGSIZE ? m->length - ofs : PGSIZE, ofs);
+    pagedir_clear_page(t->pagedir, page);
+    palloc_free_page(kpage);
+  }
+  list_remove(&m->elem);
+  file_close(m->file);
+  free(m);
+}
+
+/* Removes the current process's mapping MAPID, if it exists. */
+void mmap_unmap(int mapid) {
+  struct thread* t = thread_current();
+  struct list_elem* e;
+
+  for (e = list_begin(&t->mappings); e != list_end(&t->mappings); e = list_next(e)) {
+    struct mapping* m = list_entry(e, struct mapping, elem);
+    if (m->id == mapid) {
+      unmap(m);
+      return;
+    }
+  }
+}
+
+/* Removes all of the current process's mappings.  Must be called
+   before its page directory is destroyed. */
+void mmap_unmap_all(void) {
+  struct thread* t = thread_current();
+
+  while (!list_empty(&t->mappings))
+    unmap(list_entry(list_front(&t->mappings), struct mapping, elem));
+}
+
+/* Brings in the page holding user address ADDR if it belongs to
+   one of the current process's mappings and is not present yet.
+   Returns true if the page is now present because of a mapping,
+   false if ADDR is not mapped or memory is short. */
+bool mmap_load(const void* addr) {
+  struct thread* t = thread_current();
+  struct mapping* m;
+  uint8_t* page = pg_round_down(addr);
+  uint8_t* kpage;
+  off_t ofs;
+
+  if (!is_user_vaddr(addr) || list_empty(&t->mappings) || (m = find_mapping(page)) == NULL)
+    return false;
+  if (pagedir_get_page(t->pagedir, page) != NULL)
+    return true;
+
+  kpage = palloc_get_page(PAL_USER | PAL_ZERO);
+  if (kpage == NULL)
+    return false;
+  ofs = page - m->addr;
+  file_read_at(m->file, kpage, m->length - ofs < PGSIZE ? m->length - ofs : PGSIZE, ofs);
+  if (!pagedir_set_page(t->pagedir, page, kpage, true)) {
+    palloc_free_page(kpage);
+    return false;
+  }
+  return true;
+}
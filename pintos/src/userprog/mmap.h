@@ -0,0 +1,14 @@
+#ifndef USERPROG_MMAP_H
+#define USERPROG_MMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct file;
+
+int mmap_map(struct file*, void* addr);
+void mmap_unmap(int mapid);
+void mmap_unmap_all(void);
+bool mmap_load(const void* addr);
+
+#endif /* userprog/mmap.h */
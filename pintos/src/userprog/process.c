@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "userprog/gdt.h"
+#include "userprog/mmap.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
@@ -65,9 +66,16 @@ static void start_process(void* file_name_) {
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load(file_name, &if_.eip, &if_.esp);
   struct thread* t = thread_current();
 
+  /* Inherit the working directory.  The parent is blocked until
+     the load finishes, so its working directory cannot change
+     meanwhile. */
+  if (t->parent_process != NULL && t->parent_process->cwd != NULL)
+    t->cwd = dir_reopen(t->parent_process->cwd);
+
+  success = load(file_name, &if_.eip, &if_.esp);
+
   struct child_thread* ctt = thread_child_id(t->parent_process, t->tid);
   if (ctt != NULL) {
     ctt->loaded_result = success;
@@ -120,12 +128,28 @@ int process_wait(tid_t child_tid) {
 void process_exit(void) {
   struct thread* cur = thread_current();
   uint32_t* pd;
+  int i;
 
   if (thread_current()->tfp != NULL) {
     file_allow_write(thread_current()->tfp);
     file_close(thread_current()->tfp);
   }
 
+  /* Write back and drop memory-mapped files while the page
+     directory still exists. */
+  if (cur->pagedir != NULL)
+    mmap_unmap_all();
+
+  /* Close open files here rather than when the thread is freed:
+     closing may write back or free the inode, which can sleep. */
+  for (i = 0; i < cur->file_cnt; i++)
+    file_close(cur->files[i]);
+  free(cur->files);
+  cur->files = NULL;
+  cur->file_cnt = 0;
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -1,8 +1,15 @@
 #include "userprog/syscall.h"
+#include "userprog/mmap.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "userprog/tss.h"
+#include "userprog/uaccess.h"
+#include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <uio.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/pte.h"
@@ -10,154 +17,253 @@
 #include "filesys/filesys.h"
 #include "filesys/directory.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "threads/palloc.h"
 
 static struct lock filesys_lock;
 
-static void syscall_handler(struct intr_frame*);
+/* Most entries returned by one getdents call. */
+#define GETDENTS_MAX 128
 
+/* Model-specific registers that set up SYSENTER. */
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+/* Stack that SYSENTER switches to.  syscall_sysenter only reads
+   its last word, the address of the TSS's esp0, off it, but a #DB
+   trap taken at syscall_sysenter runs its handler on it, so it
+   must hold an interrupt frame and intr_handler()'s call. */
+static void* sysenter_stack[256];
+
+/* Returns true if the CPU supports SYSENTER and SYSEXIT.  Early
+   Pentium Pros report the feature without having it.  The same
+   test picks the entry path in lib/user/syscall.c. */
+static bool cpu_has_sysenter(void) {
+  uint32_t eax = 1, ebx, ecx = 0, edx;
+
+  asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "+c"(ecx), "=d"(edx));
+  return (edx & (1 << 11)) != 0 && (eax & 0x0fff3fff) >= 0x633;
+}
+
+/* Writes VALUE to model-specific register MSR. */
+static void wrmsr(uint32_t msr, uint32_t value) {
+  asm volatile("wrmsr" : : "c"(msr), "a"(value), "d"(0));
+}
+
+/* System calls come in through int $0x30, or through SYSENTER,
+   which skips the interrupt gate and its dispatch and returns
+   with SYSEXIT instead of iret.  SYSENTER enters at
+   syscall_sysenter in userprog/sysenter.S on sysenter_stack,
+   which moves to the stack that the TSS records for the running
+   thread. */
 void syscall_init(void) {
   lock_init(&filesys_lock);
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
+  if (cpu_has_sysenter()) {
+    wrmsr(MSR_SYSENTER_CS, SEL_KCSEG);
+    void** top = &sysenter_stack[sizeof sysenter_stack / sizeof *sysenter_stack - 1];
+
+    *top = tss_esp0();
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)top);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)syscall_sysenter);
+  }
 }
 
 void bad_exit(bool lock) {
-  if (lock)
+  if (lock) {
+    journal_end();
     lock_release(&filesys_lock);
+  }
   printf("%s: exit(-1)\n", &thread_current()->name);
   thread_exit();
 }
 
+// checks that SIZE bytes at START lie in user memory, without touching
+// them: the data itself only moves through copy_from_user() and
+// copy_to_user(), which fail softly
 bool check_memory(uint8_t* start, int size, bool lock) {
-  if (start + size > PHYS_BASE)
-    bad_exit(lock);
-  if (start < 0x08048000)
+  if (start < (uint8_t*)0x08048000 || size < 0 || !is_user_range(start, size))
     bad_exit(lock);
-  struct thread* t = thread_current();
-  uintptr_t target_pd_no = pd_no(start + size);
-  uintptr_t target_pt_no = pt_no(start + size);
-  uintptr_t current_pd_no = pd_no(start);
-  uintptr_t current_pt_no = pt_no(start);
-
-  for (; current_pd_no <= target_pd_no; current_pd_no++) {
-    uint32_t* pde = t->pagedir + current_pd_no;
-    if (*pde == 0)
-      bad_exit(lock);
-    uint32_t* pt = pde_get_pt(*pde);
-
-    for (; (current_pt_no < 1024) &&
-           ((current_pd_no < target_pd_no) || (current_pt_no <= target_pt_no));
-         current_pt_no += 1) {
-      // printf("pd: %d pg: %d \n", pd_no(current_pt), pg_no(current_pt));
-      // printf("tpd: %d tpg: %d \n", target_pd_no, target_pg_no);
-
-      if (!(pt[current_pt_no] & PTE_U || pt[current_pt_no] & PTE_P))
-        bad_exit(lock); //page table does not exist or is not owned by user.
-    }
-    current_pt_no = 0;
-  }
   return true;
 }
 
-void check_int(void* loc, bool lock) { check_memory(loc, 4, lock); }
+void check_int(void* loc, bool lock) {
+  uint32_t value;
 
-bool check_memory_str(void* start_act, bool lock) {
-  int sz = 0;
-  check_int(start_act, lock);
-
-  uint8_t* start = (*(uint8_t**)start_act);
-
-  if (start < 0x08048000)
+  if (!copy_from_user(&value, loc, sizeof value))
     bad_exit(lock);
-  struct thread* t = thread_current();
-  uintptr_t current_pd_no = pd_no(start);
-  uintptr_t current_pt_no = pt_no(start);
-
-  for (;; current_pd_no++) {
-    uint32_t* pde = t->pagedir + current_pd_no;
-    if (*pde == 0)
-      bad_exit(lock);
-    uint32_t* pt = pde_get_pt(*pde);
-    for (; current_pt_no < 1024; current_pt_no += 1) {
-      // printf("pd: %d pg: %d \n", pd_no(current_pt), pg_no(current_pt));
-      // printf("tpd: %d tpg: %d \n", target_pd_no, target_pg_no);
-
-      if (!(pt[current_pt_no] & PTE_U || pt[current_pt_no] & PTE_P))
-        bad_exit(lock); //page table does not exist or is not owned by user.
-
-      //current page exists so try looking for null character here.
-      char* bckup = start;
-      while ((uintptr_t)start >> 12 == (uintptr_t)bckup >> 12) // iterate only in same page
-      {
-        if (*start == 0)
-          return true;
-        start++;
-      }
-    }
-  }
 }
-struct file* fd_to_file(int fd) {
-  /* data */
-  struct file_descriptor* ds = NULL;
-  struct list_elem* e;
-
-  for (e = list_begin(&thread_current()->files_lst); e != list_end(&thread_current()->files_lst);
-       e = list_next(e)) {
-    ds = list_entry(e, struct file_descriptor, elem);
-    if (ds->fd == fd)
-      break;
+
+// copies the string pointed to by the argument at START_ACT into a new
+// kernel page, which the caller frees; returns NULL if memory is short
+// or the string does not fit in a page, and kills the process if the
+// string is not readable user memory
+static char* copy_str(void* start_act) {
+  const char* start;
+  char* page;
+  int len;
+
+  if (!copy_from_user(&start, start_act, sizeof start) || start < (const char*)0x08048000)
+    bad_exit(false);
+  page = palloc_get_page(0);
+  if (page == NULL)
+    return NULL;
+  len = strncpy_from_user(page, start, PGSIZE);
+  if (len < 0) {
+    palloc_free_page(page);
+    bad_exit(false);
+  }
+  if (len == PGSIZE) {
+    palloc_free_page(page);
+    return NULL;
   }
+  return page;
+}
+// returns the current process's open file for FD, or NULL if FD is not open
+static struct file* fd_lookup(int fd) {
+  struct thread* t = thread_current();
 
-  if (ds == NULL)
-    bad_exit(true);
-  if (ds->closed)
-    bad_exit(true);
-  return ds->fp;
+  return fd >= 0 && fd < t->file_cnt ? t->files[fd] : NULL;
+}
+
+// LOCK says whether filesys_lock is held and must be dropped on a bad fd
+struct file* fd_to_file(int fd, bool lock) {
+  struct file* file = fd_lookup(fd);
+
+  if (file == NULL)
+    bad_exit(lock);
+  return file;
 }
 
 void close_fd(int fd) {
-  /* data */
-  struct file_descriptor* ds = NULL;
-  struct list_elem* e;
-
-  for (e = list_begin(&thread_current()->files_lst); e != list_end(&thread_current()->files_lst);
-       e = list_next(e)) {
-    ds = list_entry(e, struct file_descriptor, elem);
-    if (ds->fd == fd)
-      break;
-  }
+  struct thread* t = thread_current();
 
-  if (ds == NULL)
-    bad_exit(true);
-  if (ds->closed)
-    bad_exit(true);
-  ds->closed = true;
-  file_close(ds->fp);
+  file_close(fd_to_file(fd, true));
+  t->files[fd] = NULL;
+  if (fd < t->file_hint)
+    t->file_hint = fd;
 }
 
+/* First fd handed out; 0 and 1 are the console. */
+#define FD_FIRST 2
+
+/* Gives FP the lowest free fd of the current process, growing its
+   fd table if every slot is taken, and returns the fd.  Returns -1
+   if FP is null, or closes FP and returns -1 if memory is short. */
 int file_add(struct file* fp) {
+  struct thread* t = thread_current();
+  int fd;
+
   if (fp == NULL)
     return -1;
-  int fd = (thread_current()->file_allocd++);
-  struct file_descriptor* ds = malloc(sizeof(struct file_descriptor));
-  ds->fd = fd;
-  ds->fp = fp;
-  ds->closed = false;
-  list_push_front(&thread_current()->files_lst, &ds->elem);
+  for (fd = t->file_hint > FD_FIRST ? t->file_hint : FD_FIRST; fd < t->file_cnt; fd++)
+    if (t->files[fd] == NULL)
+      break;
+  if (fd == t->file_cnt) {
+    int cnt = t->file_cnt > 0 ? t->file_cnt * 2 : 16;
+    struct file** files = realloc(t->files, cnt * sizeof *files);
+    if (files == NULL) {
+      file_close(fp);
+      return -1;
+    }
+    memset(files + t->file_cnt, 0, (cnt - t->file_cnt) * sizeof *files);
+    t->files = files;
+    t->file_cnt = cnt;
+  }
+  t->files[fd] = fp;
+  t->file_hint = fd + 1;
   return fd;
 }
 
-int write(int fd, const void* buffer, unsigned size) {
-  if (fd == 1)
-    return printf("%.*s", size, (const char*)buffer);
+// moves SIZE bytes between the user buffer UBUF and FILE, or the
+// console if FILE is NULL, at OFS, or at FILE's position if OFS is
+// negative; READING fills UBUF.  The data goes through a kernel page a
+// chunk at a time, so UBUF is only touched by copy_from_user() and
+// copy_to_user(), with no lock held, and a mapped page is read in by
+// the fault.  Returns the bytes moved, stopping after a short transfer,
+// or -1 if memory is short or FILE fails the first chunk; kills the
+// process if UBUF is bad
+static int transfer(struct file* file, uint8_t* ubuf, int size, off_t ofs, bool reading) {
+  uint8_t* page = palloc_get_page(0);
+  int done = 0;
+
+  if (page == NULL)
+    return -1;
+  while (done < size) {
+    int chunk = size - done < PGSIZE ? size - done : PGSIZE;
+    int n;
+
+    if (reading) {
+      n = ofs < 0 ? file_read(file, page, chunk) : file_read_at(file, page, chunk, ofs + done);
+      if (n > 0 && !copy_to_user(ubuf + done, page, n)) {
+        palloc_free_page(page);
+        bad_exit(false);
+      }
+    } else {
+      if (!copy_from_user(page, ubuf + done, chunk)) {
+        palloc_free_page(page);
+        bad_exit(false);
+      }
+      if (file == NULL)
+        n = printf("%.*s", chunk, (const char*)page);
+      else
+        n = ofs < 0 ? file_write(file, page, chunk) : file_write_at(file, page, chunk, ofs + done);
+    }
+    if (n <= 0) {
+      if (done == 0)
+        done = n;
+      break;
+    }
+    done += n;
+    if (n < chunk)
+      break;
+  }
+  palloc_free_page(page);
+  return done;
+}
 
-  return file_write(fd_to_file(fd), buffer, size);
+/* Reads into, or if WRITING writes from, the CNT user buffers
+   described by the user array UIOV, in order, at FD's current
+   position.  The array is copied in and every buffer's range is
+   checked once, before any I/O.  Returns the number of bytes
+   transferred, stopping after the first short transfer, or -1 if
+   CNT is out of range. */
+static int vector_io(int fd, const struct iovec* uiov, int cnt, bool writing) {
+  struct iovec iov[IOV_MAX];
+  struct file* file = NULL;
+  int total = 0;
+  int i;
+
+  if (cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if (!copy_from_user(iov, uiov, cnt * sizeof *uiov))
+    bad_exit(false);
+  for (i = 0; i < cnt; i++)
+    if (iov[i].iov_len > 0)
+      check_memory(iov[i].iov_base, iov[i].iov_len, false);
+  if (!writing || fd != 1)
+    file = fd_to_file(fd, false);
+
+  for (i = 0; i < cnt; i++) {
+    int n;
+
+    if (iov[i].iov_len == 0)
+      continue;
+    n = transfer(file, iov[i].iov_base, iov[i].iov_len, -1, !writing);
+    if (n < 0)
+      return total > 0 ? total : -1;
+    total += n;
+    if ((size_t)n < iov[i].iov_len)
+      break;
+  }
+  return total;
 }
 
 // int read(int fd, void* buffer, unsigned size) {
 //   if()
 // }
-static void syscall_handler(struct intr_frame* f UNUSED) {
+void syscall_handler(struct intr_frame* f UNUSED) {
   uint32_t* args = ((uint32_t*)f->esp);
 
   /*
@@ -176,55 +282,182 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     set_exit_code(args[1]);
     printf("%s: exit(%d)\n", &thread_current()->name, args[1]);
     thread_exit();
-  } else if (args[0] == SYS_WRITE || args[0] == SYS_CREATE || args[0] == SYS_REMOVE ||
-             args[0] == SYS_OPEN || args[0] == SYS_FILESIZE || args[0] == SYS_READ ||
-             args[0] == SYS_SEEK || args[0] == SYS_TELL || args[0] == SYS_CLOSE ||
-             args[0] == SYS_REMOVE || args[0] == SYS_INUMBER || args[0] == SYS_MKDIR ||
-             args[0] == SYS_CHDIR || args[0] == SYS_ISDIR || args[0] == SYS_READDIR) {
-    // filesys is not thread-safe
-    lock_acquire(&filesys_lock);
-
+  } else if (args[0] == SYS_WRITE || args[0] == SYS_READ || args[0] == SYS_SEEK ||
+             args[0] == SYS_TELL || args[0] == SYS_FILESIZE || args[0] == SYS_FSYNC ||
+             args[0] == SYS_SYNC || args[0] == SYS_PREAD || args[0] == SYS_PWRITE ||
+             args[0] == SYS_READV || args[0] == SYS_WRITEV || args[0] == SYS_COPY_FILE_RANGE ||
+             args[0] == SYS_MMAP || args[0] == SYS_MUNMAP || args[0] == SYS_FALLOCATE ||
+             args[0] == SYS_FCNTL || args[0] == SYS_CLONE_FILE) {
+    // data path: inodes lock their own metadata and byte ranges, so
+    // these run concurrently without filesys_lock
     switch (args[0]) {
       case SYS_WRITE:
-        check_int(args + 1, true);
-        check_int(args + 3, true);
-        check_memory_str(args + 2, true);
-        f->eax = write(args[1], args[2], args[3]);
-        break;
-      case SYS_CREATE:
-        check_memory_str(args + 1, true);
-        check_int(args + 2, true);
-        f->eax = filesys_create(args[1], args[2]);
-        break;
-      case SYS_OPEN:
-        check_memory_str(args + 1, true);
-        f->eax = file_add(filesys_open(args[1]));
+        check_int(args + 1, false);
+        check_int(args + 3, false);
+        check_memory((uint8_t*)args[2], args[3], false);
+        f->eax = transfer(args[1] == 1 ? NULL : fd_to_file(args[1], false), (uint8_t*)args[2],
+                          args[3], -1, false);
         break;
 
       case SYS_FILESIZE:
-        check_int(args + 1, true);
-        f->eax = file_length(fd_to_file(args[1]));
-        // TODO
+        check_int(args + 1, false);
+        f->eax = file_length(fd_to_file(args[1], false));
         break;
 
       case SYS_READ:
-        check_int(args + 1, true);
-        check_int(args + 2, true);
-        check_int(args + 3, true);
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        check_int(args + 3, false);
 
-        check_memory(args[2], args[3], true);
-        f->eax = file_read(fd_to_file(args[1]), args[2], args[3]);
+        check_memory((uint8_t*)args[2], args[3], false);
+        f->eax = transfer(fd_to_file(args[1], false), (uint8_t*)args[2], args[3], -1, true);
         break;
 
       case SYS_SEEK:
-        check_int(args + 1, true);
-        check_int(args + 2, true);
-        file_seek(fd_to_file(args[1]), args[2]);
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        file_seek(fd_to_file(args[1], false), args[2]);
         break;
 
       case SYS_TELL:
-        check_int(args + 1, true);
-        f->eax = file_tell(fd_to_file(args[1]));
+        check_int(args + 1, false);
+        f->eax = file_tell(fd_to_file(args[1], false));
+        break;
+
+      // positional I/O leaves the file position alone
+      case SYS_PREAD:
+      case SYS_PWRITE: {
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        check_int(args + 3, false);
+        check_int(args + 4, false);
+        check_memory((uint8_t*)args[2], args[3], false);
+        struct file* file = fd_to_file(args[1], false);
+        if ((off_t)args[4] < 0)
+          f->eax = -1;
+        else
+          f->eax = transfer(file, (uint8_t*)args[2], args[3], args[4], args[0] == SYS_PREAD);
+        break;
+      }
+
+      case SYS_READV:
+      case SYS_WRITEV:
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        check_int(args + 3, false);
+        f->eax = vector_io(args[1], (const struct iovec*)args[2], args[3], args[0] == SYS_WRITEV);
+        break;
+
+      case SYS_COPY_FILE_RANGE:
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        check_int(args + 3, false);
+        f->eax = file_copy(fd_to_file(args[2], false), fd_to_file(args[1], false), args[3]);
+        break;
+
+      case SYS_CLONE_FILE:
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        f->eax = file_clone(fd_to_file(args[2], false), fd_to_file(args[1], false));
+        break;
+
+      case SYS_FALLOCATE:
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        check_int(args + 3, false);
+        f->eax = file_allocate(fd_to_file(args[1], false), args[2], args[3]);
+        break;
+
+      case SYS_FCNTL: {
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        check_int(args + 3, false);
+        struct file* file = fd_to_file(args[1], false);
+        if (args[2] == F_GETFL)
+          f->eax = (file_is_direct(file) ? O_DIRECT : 0) |
+                   (inode_is_compressed(file_get_inode(file)) ? O_COMPRESS : 0);
+        else if (args[2] == F_SETFL) {
+          // compression belongs to the inode, and only changes while it is empty
+          if (inode_set_compressed(file_get_inode(file), (args[3] & O_COMPRESS) != 0)) {
+            file_set_direct(file, (args[3] & O_DIRECT) != 0);
+            f->eax = 0;
+          } else
+            f->eax = -1;
+        } else
+          f->eax = -1;
+        break;
+      }
+
+      // mappings belong to the process, and file pages move through
+      // the inode's own locking
+      case SYS_MMAP: {
+        check_int(args + 1, false);
+        check_int(args + 2, false);
+        // a bad fd fails the call rather than killing the process
+        struct file* file = fd_lookup(args[1]);
+        f->eax = file == NULL ? -1 : mmap_map(file, (void*)args[2]);
+        break;
+      }
+
+      case SYS_MUNMAP:
+        check_int(args + 1, false);
+        mmap_unmap(args[1]);
+        break;
+
+      // concurrent callers share one journal commit, so neither
+      // takes filesys_lock
+      case SYS_FSYNC:
+        check_int(args + 1, false);
+        fd_to_file(args[1], false);
+        journal_sync();
+        f->eax = true;
+        break;
+
+      case SYS_SYNC:
+        // removed files' blocks go back to the free map before it is committed
+        inode_reclaim_wait();
+        journal_sync();
+        break;
+
+      default:
+        break;
+    }
+  } else if (args[0] == SYS_CREATE || args[0] == SYS_REMOVE || args[0] == SYS_OPEN ||
+             args[0] == SYS_CLOSE || args[0] == SYS_INUMBER || args[0] == SYS_MKDIR ||
+             args[0] == SYS_CHDIR || args[0] == SYS_ISDIR || args[0] == SYS_READDIR ||
+             args[0] == SYS_GETDENTS) {
+    char* path = NULL;
+    char name[NAME_MAX + 1];
+    struct dirent* entries = NULL;
+    void* udst = NULL;
+    const void* result = NULL;
+    size_t result_size = 0;
+
+    // paths are copied in before filesys_lock is taken, and results
+    // copied out after it is released, so that a fault on a mapped page
+    // is served with no file system lock held
+    if (args[0] == SYS_CREATE)
+      check_int(args + 2, false);
+    if (args[0] == SYS_CREATE || args[0] == SYS_REMOVE || args[0] == SYS_OPEN ||
+        args[0] == SYS_MKDIR || args[0] == SYS_CHDIR) {
+      path = copy_str(args + 1);
+      if (path == NULL) {
+        f->eax = args[0] == SYS_OPEN ? -1 : false;
+        return;
+      }
+    }
+
+    // directory operations are not thread-safe, and each must reach
+    // the journal as a whole
+    lock_acquire(&filesys_lock);
+    journal_begin();
+
+    switch (args[0]) {
+      case SYS_CREATE:
+        f->eax = filesys_create(path, args[2]);
+        break;
+      case SYS_OPEN:
+        f->eax = file_add(filesys_open(path));
         break;
 
       case SYS_CLOSE:
@@ -233,50 +466,77 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
         break;
 
       case SYS_REMOVE:
-        check_memory_str(args + 1, true);
-        f->eax = filesys_remove(args[1]);
+        f->eax = filesys_remove(path);
         break;
 
       case SYS_INUMBER:
         check_int(args + 1, true);
-        f->eax = inode_get_inumber(file_get_inode(fd_to_file(args[1])));
+        f->eax = inode_get_inumber(file_get_inode(fd_to_file(args[1], true)));
         break;
 
         // CASE SYS_CHDIR:
       case SYS_MKDIR:
-        check_memory_str(args + 1, true);
-        f->eax = mkdir(args[1]);
+        f->eax = mkdir(path);
         break;
 
       case SYS_CHDIR:
-        check_memory_str(args + 1, true);
-        f->eax = chdir(args[1]);
+        f->eax = chdir(path);
         break;
 
       case SYS_ISDIR:
         check_int(args + 1, true);
-        f->eax = inode_is_dir(file_get_inode(fd_to_file(args[1])));
+        f->eax = inode_is_dir(file_get_inode(fd_to_file(args[1], true)));
         break;
 
       case SYS_READDIR:
         check_int(args + 1, true);
         check_int(args + 2, true);
-        check_memory(args[2], 15, true);
-        f->eax = userprog_readdir(fd_to_file(args[1]), args[2]);
+        f->eax = userprog_readdir(fd_to_file(args[1], true), name);
+        if (f->eax) {
+          udst = (void*)args[2];
+          result = name;
+          result_size = strlen(name) + 1;
+        }
         break;
+
+      case SYS_GETDENTS: {
+        check_int(args + 1, true);
+        check_int(args + 2, true);
+        check_int(args + 3, true);
+        struct file* file = fd_to_file(args[1], true);
+        // the entries are gathered in a page, which holds GETDENTS_MAX
+        size_t cnt = args[3] < GETDENTS_MAX ? args[3] : GETDENTS_MAX;
+        check_memory((uint8_t*)args[2], cnt * sizeof(struct dirent), true);
+        entries = palloc_get_page(0);
+        f->eax = entries == NULL ? -1 : userprog_getdents(file, entries, cnt);
+        if ((int)f->eax > 0) {
+          udst = (void*)args[2];
+          result = entries;
+          result_size = f->eax * sizeof *entries;
+        }
+        break;
+      }
       default:
         break;
     }
 
+    journal_end();
     lock_release(&filesys_lock);
+    palloc_free_page(path);
+    if (result_size > 0 && !copy_to_user(udst, result, result_size)) {
+      palloc_free_page(entries);
+      bad_exit(false);
+    }
+    palloc_free_page(entries);
   } else if (args[0] == SYS_PRACTICE) {
     check_int(args + 1, false);
     f->eax = args[1] + 1;
   } else if (args[0] == SYS_HALT) {
     shutdown_power_off();
   } else if (args[0] == SYS_EXEC) {
-    check_memory_str(args + 1, false);
-    f->eax = process_execute(args[1]);
+    char* cmd_line = copy_str(args + 1);
+    f->eax = cmd_line == NULL ? -1 : process_execute(cmd_line);
+    palloc_free_page(cmd_line);
 
   } else if (args[0] == SYS_WAIT) {
     check_int(args + 1, false);
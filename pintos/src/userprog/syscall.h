@@ -1,6 +1,10 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+struct intr_frame;
+
 void syscall_init(void);
+void syscall_handler(struct intr_frame*);
+void syscall_sysenter(void);
 
 #endif /* userprog/syscall.h */
@@ -91,6 +91,15 @@ struct tss* tss_get(void) {
   return tss;
 }
 
+/* Returns the address of the ring 0 stack pointer in the TSS.
+   SYSENTER loads its stack pointer from here, through one more
+   indirection, so that it always finds the current thread's
+   stack without reprogramming an MSR on every thread switch. */
+void** tss_esp0(void) {
+  ASSERT(tss != NULL);
+  return &tss->esp0;
+}
+
 /* Sets the ring 0 stack pointer in the TSS to point to the end
    of the thread stack. */
 void tss_update(void) {
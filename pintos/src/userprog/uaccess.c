@@ -0,0 +1,132 @@
+#include "userprog/uaccess.h"
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Access to user memory from the kernel.
+
+   These routines touch user memory directly, without first
+   checking that it is mapped.  Each instruction that may fault on
+   a user address has an entry in the exception table, which
+   page_fault() consults for faults in kernel context: execution
+   then resumes at the entry's fixup address instead of the kernel
+   panicking, and the routine reports failure.  Valid accesses,
+   the common case, cost no more than a plain copy.
+
+   The table is built by the linker from the __ex_table sections
+   of the entries below, between _start_ex_table and
+   _end_ex_table (see threads/kernel.lds.S). */
+
+/* An exception table entry. */
+struct ex_entry {
+  uintptr_t insn;  /* Address of an instruction that may fault. */
+  uintptr_t fixup; /* Where to resume if it does. */
+};
+
+extern const struct ex_entry _start_ex_table[], _end_ex_table[];
+
+/* Returns true if the SIZE bytes at UADDR lie wholly in user
+   virtual memory, without wrapping around the address space. */
+bool is_user_range(const void* uaddr, size_t size) {
+  uintptr_t start = (uintptr_t)uaddr;
+  return start + size >= start && start + size <= (uintptr_t)PHYS_BASE;
+}
+
+/* Copies SIZE bytes from SRC to DST, either of which may be a user
+   address, and returns the number of bytes left uncopied: 0 if
+   successful, nonzero if a fault stopped the copy.  A fault
+   leaves %ecx counting the bytes left, and REP MOVSB resumes at
+   the following instruction, so the fixup needs no code. */
+static size_t copy_user(void* dst, const void* src, size_t size) {
+  asm volatile("1: rep movsb\n"
+               "2:\n"
+               ".pushsection __ex_table, \"a\"\n"
+               ".long 1b, 2b\n"
+               ".popsection"
+               : "+D"(dst), "+S"(src), "+c"(size)
+               :
+               : "memory");
+  return size;
+}
+
+/* Returns the byte at user address UADDR, or -1 if reading it
+   faults. */
+static int get_user(const uint8_t* uaddr) {
+  int result = -1;
+  asm volatile("1: movzbl %1, %0\n"
+               "2:\n"
+               ".pushsection __ex_table, \"a\"\n"
+               ".long 1b, 2b\n"
+               ".popsection"
+               : "+r"(result)
+               : "m"(*uaddr));
+  return result;
+}
+
+/* Copies SIZE bytes from user address USRC to DST.  Returns true
+   if successful, false if USRC is not a valid user range. */
+bool copy_from_user(void* dst, const void* usrc, size_t size) {
+  return is_user_range(usrc, size) && copy_user(dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from SRC to user address UDST.  Returns true
+   if successful, false if UDST is not a valid, writable user
+   range; part of it may have been written. */
+bool copy_to_user(void* udst, const void* src, size_t size) {
+  return is_user_range(udst, size) && copy_user(udst, src, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, copying at most SIZE bytes.  Returns the length of the
+   string, not counting the null terminator, if it fit in SIZE
+   bytes, or SIZE if it did not, in which case DST is not null
+   terminated.  Returns -1 if the string runs into memory that is
+   not valid user memory. */
+int strncpy_from_user(char* dst, const char* usrc, size_t size) {
+  const uint8_t* p = (const uint8_t*)usrc;
+  size_t i;
+
+  for (i = 0; i < size; i++) {
+    int c;
+
+    if (!is_user_vaddr(p + i) || (c = get_user(p + i)) < 0)
+      return -1;
+    dst[i] = c;
+    if (c == '\0')
+      return i;
+  }
+  return size;
+}
+
+/* Returns the exception table entry for the instruction at EIP,
+   or a null pointer if there is none. */
+static const struct ex_entry* search_ex_table(void (*eip)(void)) {
+  const struct ex_entry* e;
+
+  for (e = _start_ex_table; e < _end_ex_table; e++)
+    if (e->insn == (uintptr_t)eip)
+      return e;
+  return NULL;
+}
+
+/* Returns true if the fault in kernel context described by F
+   happened in one of the routines above, so that it may be served
+   by reading a mapped file.  Their callers hold no inode lock and
+   do not wait on the cache; the system call handler moves buffers
+   and paths with no file system lock held, and only reads its
+   arguments under filesys_lock and the journal barrier, neither
+   of which a file read takes. */
+bool uaccess_faulted(const struct intr_frame* f) { return search_ex_table(f->eip) != NULL; }
+
+/* Called by page_fault() for a fault in kernel context described
+   by F.  If the faulting instruction has an exception table
+   entry, arranges for F to resume at its fixup and returns true.
+   Otherwise, returns false. */
+bool uaccess_fixup(struct intr_frame* f) {
+  const struct ex_entry* e = search_ex_table(f->eip);
+
+  if (e == NULL)
+    return false;
+  f->eip = (void (*)(void))e->fixup;
+  return true;
+}